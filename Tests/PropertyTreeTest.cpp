@@ -0,0 +1,457 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include <Utils/PropertyTreeNode.h>
+#include <Utils/PropertySnapshot.h>
+#include <Core/IListener.h>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Utils;
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            cerr << __FILE__ << ":" << __LINE__ << ": " #cond << endl;  \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+static const string FILE_A = "PropertyTreeTest.a.yaml";
+static const string FILE_B = "PropertyTreeTest.b.yaml";
+
+// written next to the file and renamed, so a watcher never sees half
+static void Write(const string& file, const string& text) {
+    string tmp = file + ".tmp";
+    {
+        ofstream out(tmp.c_str());
+        out << text;
+    }
+    rename(tmp.c_str(), file.c_str());
+}
+
+static void Tick(PropertyTree& tree) {
+    tree.Handle(Core::ProcessEventArg(Time(), 0));
+}
+
+struct Counter : public Core::IListener<PropertiesChangedEventArg> {
+    int count;
+    PropertiesChangedEventArg::ChangeFlag flags;
+    Counter() : count(0), flags(PropertiesChangedEventArg::ChangeFlag(0)) {}
+    void Handle(PropertiesChangedEventArg arg) {
+        count++;
+        flags = arg.GetFlags();
+    }
+};
+
+static void TestScalarRoundTrip() {
+    Write(FILE_A,
+          "name: hello\n"
+          "count: 42\n"
+          "scale: 0.5\n"
+          "nested:\n"
+          "  deep:\n"
+          "    value: -3\n");
+    PropertyTree tree;
+    tree.LoadFromFile(FILE_A);
+    PropertyTreeNode* root = tree.GetRootNode();
+    CHECK(root->GetPath("count", 0) == 42);
+    CHECK(root->GetPath("scale", 0.0f) == 0.5f);
+    CHECK(root->GetPath("nested.deep.value", 0) == -3);
+    tree.SaveToFile(FILE_B);
+
+    PropertyTree copy;
+    copy.LoadFromFile(FILE_B);
+    const PropertyTreeNode* c = copy.GetRootNode();
+    CHECK(c->GetOr("name", string()) == "hello");
+    CHECK(c->GetOr("count", 0) == 42);
+    CHECK(c->GetOr("scale", 0.0f) == 0.5f);
+    CHECK(c->GetOr("nested.deep.value", 0) == -3);
+}
+
+static void TestPackedRoundTrip() {
+    Write(FILE_A,
+          "ints: [1, 2, 3, 4]\n"
+          "floats: [0.25, 1.5, -2]\n"
+          "pos: [1, 2, 3]\n");
+    PropertyTree tree;
+    tree.LoadFromFile(FILE_A);
+    PropertyTreeNode* root = tree.GetRootNode();
+    CHECK(root->GetNode("ints")->IsPacked());
+    CHECK(root->GetNode("ints")->GetArray<int>().GetSize() == 4);
+    Math::Vector<3,float> pos = root->GetPath("pos", Math::Vector<3,float>());
+    CHECK(pos[0] == 1 && pos[1] == 2 && pos[2] == 3);
+    tree.SaveToFile(FILE_B);
+
+    PropertyTree copy;
+    copy.LoadFromFile(FILE_B);
+    PropertyTreeNode* c = copy.GetRootNode();
+    PropertySpan<const int> ints = c->GetNode("ints")->GetArray<int>();
+    CHECK(ints.GetSize() == 4 && ints[0] == 1 && ints[3] == 4);
+    PropertySpan<const float> floats = c->GetNode("floats")->GetArray<float>();
+    CHECK(floats.GetSize() == 3 && floats[0] == 0.25f && floats[2] == -2);
+}
+
+static string ReadAll(const string& file) {
+    ifstream in(file.c_str());
+    return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+// numbers that would not be saved as they were written stay unpacked
+static void TestPackedKeepsText() {
+    Write(FILE_A,
+          "zips: [\"00123\", \"00456\"]\n"
+          "ratios: [1.10, 2.50]\n"
+          "plain: [1.5, 2.5]\n");
+    PropertyTree tree;
+    tree.LoadFromFile(FILE_A);
+    PropertyTreeNode* root = tree.GetRootNode();
+    CHECK(!root->GetNode("zips")->IsPacked());
+    CHECK(!root->GetNode("ratios")->IsPacked());
+    CHECK(root->GetNode("plain")->IsPacked());
+    CHECK(root->GetNode("ratios")->GetIdx(1, 0.0f) == 2.5f);
+    tree.SaveToFile(FILE_B);
+    string saved = ReadAll(FILE_B);
+    CHECK(saved.find("00123") != string::npos);
+    CHECK(saved.find("00456") != string::npos);
+    CHECK(saved.find("1.10") != string::npos);
+    CHECK(saved.find("2.50") != string::npos);
+
+    PropertyTree copy;
+    copy.LoadFromFile(FILE_B);
+    const PropertyTreeNode* c = copy.GetRootNode();
+    CHECK(c->GetOr("zips.0", string()) == "00123");
+    CHECK(c->GetOr("ratios.0", string()) == "1.10");
+    CHECK(c->GetOr("plain.1", 0.0f) == 2.5f);
+}
+
+// a scalar tag on a sequence types its elements, not the sequence
+static void TestSequenceTags() {
+    Write(FILE_A,
+          "v: !int [1, 2, 3]\n"
+          "f: !float [1, 2]\n"
+          "d: !double [0.1, 0.2]\n"
+          "s: !str [1, 2]\n");
+    PropertyTree tree;
+    tree.LoadFromFile(FILE_A);
+    PropertyTreeNode* root = tree.GetRootNode();
+    CHECK(root->GetNode("v")->IsPacked());
+    CHECK(root->GetNode("v")->GetType() == PropertyTree::UNKNOWN);
+    CHECK(root->GetNode("f")->IsPacked());
+    CHECK(root->GetNode("f")->GetArray<float>().GetSize() == 2);
+    CHECK(!root->GetNode("d")->IsPacked());
+    CHECK(root->GetNode("d")->GetIdx(0, 0.0) == 0.1);
+    CHECK(!root->GetNode("s")->IsPacked());
+    CHECK(root->GetNode("s")->GetNodeIdx(1)->GetType() == PropertyTree::STRING);
+    Tick(tree);
+    Counter v;
+    root->GetNode("v")->PropertiesChangedEvent().Attach(v);
+    Math::Vector<3,float> pos = root->GetPath("v", Math::Vector<3,float>());
+    Tick(tree);
+    CHECK(pos[2] == 3 && v.count == 0);
+    root->GetNode("v")->PropertiesChangedEvent().Detach(v);
+}
+
+static string Records(int count, int changed, int value) {
+    string text = "ents:\n";
+    for (int i = 0; i < count; i++) {
+        char line[128];
+        sprintf(line, "  - {id: %d, hp: %d, name: e%d, pos: [%d, 0, 1]}\n",
+                i, i == changed ? value : 100 + i, i, i);
+        text += line;
+    }
+    return text;
+}
+
+static void TestRecordRoundTrip() {
+    Write(FILE_A, Records(20, -1, 0));
+    PropertyTree tree;
+    tree.LoadFromFile(FILE_A);
+    PropertyTreeNode* ents = tree.GetRootNode()->GetNode("ents");
+    CHECK(ents->IsRecords() && ents->GetSize() == 20);
+    CHECK(ents->GetColumn<int>("hp")[7] == 107);
+    tree.SaveToFile(FILE_B);
+
+    PropertyTree copy;
+    copy.LoadFromFile(FILE_B);
+    const PropertyTreeNode* c = copy.GetRootNode();
+    CHECK(c->Find("ents")->IsRecords());
+    CHECK(c->GetOr("ents.7.hp", 0) == 107);
+    CHECK(c->GetOr("ents.7.name", string()) == "e7");
+    CHECK(c->GetOr("ents.7.pos.0", 0) == 7);
+}
+
+// quoted record values stay text, not numbers
+static void TestRecordKeepsText() {
+    Write(FILE_A,
+          "ents:\n"
+          "  - {id: \"003\", hp: 1}\n"
+          "  - {id: \"010\", hp: 2}\n");
+    PropertyTree tree;
+    tree.LoadFromFile(FILE_A);
+    tree.SaveToFile(FILE_B);
+    PropertyTree copy;
+    copy.LoadFromFile(FILE_B);
+    const PropertyTreeNode* c = copy.GetRootNode();
+    CHECK(c->GetOr("ents.0.id", string()) == "003");
+    CHECK(c->GetOr("ents.1.id", string()) == "010");
+    CHECK(c->GetOr("ents.1.hp", 0) == 2);
+}
+
+// cells of records that have no node yet still reach subscribers
+static void TestRecordSubscriptions() {
+    Write(FILE_A, Records(20, -1, 0));
+    PropertyTree tree;
+    tree.LoadFromFile(FILE_A);
+    Tick(tree);
+    Counter one, all, other;
+    tree.Subscribe("ents.3.hp", one);
+    tree.Subscribe("ents.*.hp", all);
+    tree.Subscribe("ents.4.hp", other);
+    Write(FILE_A, Records(20, 3, 7));
+    tree.LoadFromFile(FILE_A);
+    Tick(tree);
+    CHECK(one.count == 1 && all.count == 1 && other.count == 0);
+    CHECK(one.flags & PropertiesChangedEventArg::VALUE);
+    CHECK(tree.GetRootNode()->GetOr("ents.3.hp", 0) == 7);
+    tree.Unsubscribe("ents.3.hp", one);
+    tree.Unsubscribe("ents.*.hp", all);
+    tree.Unsubscribe("ents.4.hp", other);
+}
+
+static void TestAtoms() {
+    string text = "items:\n";
+    for (int i = 0; i < 100; i++)
+        text += "  - {enabled: on, scale: 1.0}\n";
+    Write(FILE_A, text);
+    PropertyTree tree;
+    tree.LoadFromFile(FILE_A);
+    // repeated values are stored once
+    PropertyAtomTable::Stats stats = tree.GetAtomStats();
+    CHECK(stats.atoms < 120);
+    CHECK(tree.GetRootNode()->GetOr("items.42.enabled", string()) == "on");
+
+    // values no node holds any more are swept
+    for (int i = 0; i < 2000; i++) {
+        char line[64];
+        sprintf(line, "value: v%d\n", i);
+        tree.GetRootNode()->GetNode("edited")->SetValue(line);
+    }
+    CHECK(tree.GetAtomStats().atoms < 1000);
+    CHECK(tree.GetRootNode()->GetOr("edited", string()) == "value: v1999\n");
+}
+
+// indexes of plain arrays follow Set without being rebuilt
+static void TestIndex() {
+    Write(FILE_A,
+          "items:\n"
+          "  - {id: 3, name: c}\n"
+          "  - {id: 1, name: a}\n"
+          "  - {id: 2, name: b, extra: 0}\n");
+    PropertyTree tree;
+    tree.LoadFromFile(FILE_A);
+    PropertyTreeNode* items = tree.GetRootNode()->GetNode("items");
+    CHECK(!items->IsRecords());
+    PropertyIndex* byId = items->CreateIndex("id");
+    CHECK(byId->FindIdx(1) == 1);
+    items->GetNodeIdx(1)->GetNode("id")->Set(7);
+    items->GetNodeIdx(0)->GetNode("name")->Set(string("d"));
+    CHECK(byId->FindIdx(1) == -1);
+    CHECK(byId->FindIdx(7) == 1);
+    CHECK(byId->FindIdx(3) == 0);
+    // a text key turns the index into a text index
+    items->GetNodeIdx(2)->GetNode("id")->Set(string("x"));
+    CHECK(byId->FindIdx(string("x")) == 2);
+    CHECK(byId->FindIdx(7) == 1);
+    items->GetNodeIdx(2)->GetNode("id")->Set(5);
+    CHECK(byId->FindIdx(5) == 2);
+    // so do changes of structure
+    items->GetNodeIdx(3)->GetNode("id")->Set(9);
+    CHECK(byId->FindIdx(9) == 3 && byId->GetSize() == 4);
+}
+
+// a change reaches "**" once, not once per ancestor
+static void TestDeepSubscriptions() {
+    PropertyTree tree;
+    PropertyTreeNode* root = tree.GetRootNode();
+    root->GetNode("a")->GetNode("b")->GetNode("c")->GetNode("d")->Set(1);
+    Tick(tree);
+    Counter all, below, exact;
+    tree.Subscribe("**", all);
+    tree.Subscribe("a.**", below);
+    tree.Subscribe("a.b", exact);
+    root->GetNode("a")->GetNode("b")->GetNode("c")->GetNode("d")->Set(2);
+    Tick(tree);
+    CHECK(all.count == 1 && below.count == 1);
+    CHECK(!(all.flags & PropertiesChangedEventArg::IS_RECURSIVE));
+    // patterns for the ancestor itself still see the change below
+    CHECK(exact.count == 1);
+    CHECK(exact.flags & PropertiesChangedEventArg::IS_RECURSIVE);
+    tree.Unsubscribe("**", all);
+    tree.Unsubscribe("a.**", below);
+    tree.Unsubscribe("a.b", exact);
+}
+
+static void TestReloadEvents() {
+    Write(FILE_A, "a: 1\nb: 2\nlist: [1, 2]\n");
+    PropertyTree tree;
+    tree.LoadFromFile(FILE_A);
+    PropertyTreeNode* root = tree.GetRootNode();
+    // the first load is dispatched before anyone listens
+    Tick(tree);
+    Counter a, b, all;
+    root->GetNode("a")->PropertiesChangedEvent().Attach(a);
+    root->GetNode("b")->PropertiesChangedEvent().Attach(b);
+    tree.Subscribe("**", all);
+
+    // unchanged values give no events
+    Write(FILE_A, "a: 1\nb: 2\nlist: [1, 2]\n");
+    tree.LoadFromFile(FILE_A);
+    Tick(tree);
+    CHECK(a.count == 0 && b.count == 0 && all.count == 0);
+
+    Write(FILE_A, "a: 1\nb: 3\nlist: [1, 2]\n");
+    tree.LoadFromFile(FILE_A);
+    Tick(tree);
+    CHECK(a.count == 0 && b.count == 1);
+    CHECK(b.flags & PropertiesChangedEventArg::VALUE);
+    CHECK(root->GetPath("b", 0) == 3);
+
+    // removed keys are a structure change of their parent
+    Counter structure;
+    root->PropertiesChangedEvent().Attach(structure);
+    Write(FILE_A, "a: 1\nlist: [1, 2]\n");
+    tree.LoadFromFile(FILE_A);
+    Tick(tree);
+    CHECK(structure.count == 1);
+    CHECK(structure.flags & PropertiesChangedEventArg::STRUCTURE);
+    CHECK(!root->HaveNode("b"));
+    root->GetNode("a")->PropertiesChangedEvent().Detach(a);
+    root->PropertiesChangedEvent().Detach(structure);
+    tree.Unsubscribe("**", all);
+}
+
+static void TestTransaction() {
+    PropertyTree tree;
+    PropertyTreeNode* cam = tree.GetRootNode()->GetNode("cam");
+    cam->GetNode("fov")->Set(60);
+    cam->GetNode("near")->Set(1);
+    Tick(tree);
+    Counter c, fov;
+    cam->PropertiesChangedEvent().Attach(c);
+    cam->GetNode("fov")->PropertiesChangedEvent().Attach(fov);
+    {
+        PropertyTransaction t(&tree);
+        cam->GetNode("fov")->Set(70);
+        cam->GetNode("near")->Set(2);
+        cam->GetNode("fov")->Set(80);
+        // values change right away, events wait for the commit
+        CHECK(cam->GetPath("fov", 0) == 80);
+        Tick(tree);
+        CHECK(c.count == 0 && fov.count == 0);
+    }
+    Tick(tree);
+    CHECK(c.count == 1 && fov.count == 1);
+    CHECK(c.flags & PropertiesChangedEventArg::IS_RECURSIVE);
+    CHECK(cam->GetPath("fov", 0) == 80 && cam->GetPath("near", 0) == 2);
+    cam->GetNode("fov")->PropertiesChangedEvent().Detach(fov);
+    cam->PropertiesChangedEvent().Detach(c);
+}
+
+// sets and flushes from a listener while events are dispatched
+struct Flusher : public Core::IListener<PropertiesChangedEventArg> {
+    PropertyTree* tree;
+    PropertyTreeNode* other;
+    int count;
+    Flusher(PropertyTree* tree, PropertyTreeNode* other)
+        : tree(tree), other(other), count(0) {}
+    void Handle(PropertiesChangedEventArg arg) {
+        count++;
+        other->Set(10 + count);
+        tree->FlushEvents();
+    }
+};
+
+static void TestNestedFlush() {
+    PropertyTree tree;
+    PropertyTreeNode* root = tree.GetRootNode();
+    root->GetNode("a")->Set(1);
+    root->GetNode("b")->Set(1);
+    tree.FlushEvents();
+    Flusher flusher(&tree, root->GetNode("b"));
+    Counter b;
+    root->GetNode("a")->PropertiesChangedEvent().Attach(flusher);
+    root->GetNode("b")->PropertiesChangedEvent().Attach(b);
+    root->GetNode("a")->Set(2);
+    tree.FlushEvents();
+    // the nested flush did nothing, b is sent by the next pass
+    CHECK(flusher.count == 1 && b.count == 0);
+    CHECK(root->GetPath("b", 0) == 11);
+    tree.FlushEvents();
+    CHECK(flusher.count == 1 && b.count == 1);
+    root->GetNode("a")->PropertiesChangedEvent().Detach(flusher);
+    root->GetNode("b")->PropertiesChangedEvent().Detach(b);
+}
+
+static void TestSnapshots() {
+    PropertyTree tree;
+    PropertyTreeNode* root = tree.GetRootNode();
+    root->GetNode("value")->Set(1);
+    tree.PublishSnapshot();
+    PropertySnapshot held = tree.Snapshot();
+    // newer snapshots retire the nodes held is reading
+    for (int i = 2; i < 10; i++) {
+        root->GetNode("value")->Set(i);
+        tree.PublishSnapshot();
+    }
+    CHECK(held.GetRootNode()->GetPath("value", 0) == 1);
+    {
+        PropertySnapshot current = tree.Snapshot();
+        CHECK(current.GetRootNode()->GetPath("value", 0) == 9);
+    }
+    // views that are let go free their reader slot
+    for (unsigned int i = 0; i < 4 * PropertySnapshots::MAX_READERS; i++) {
+        PropertySnapshot s = tree.Snapshot();
+        CHECK(s.GetRootNode()->GetPath("value", 0) == 9);
+    }
+    held = tree.Snapshot();
+    CHECK(held.GetRootNode()->GetPath("value", 0) == 9);
+}
+
+int main(int argc, char** argv) {
+    TestScalarRoundTrip();
+    TestPackedRoundTrip();
+    TestPackedKeepsText();
+    TestSequenceTags();
+    TestRecordRoundTrip();
+    TestRecordKeepsText();
+    TestRecordSubscriptions();
+    TestAtoms();
+    TestIndex();
+    TestDeepSubscriptions();
+    TestReloadEvents();
+    TestTransaction();
+    TestNestedFlush();
+    TestSnapshots();
+    remove(FILE_A.c_str());
+    remove(FILE_B.c_str());
+    if (failures) {
+        cerr << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "all checks passed" << endl;
+    return 0;
+}
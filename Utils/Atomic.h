@@ -0,0 +1,84 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+
+#ifndef _OE_PROPERTY_TREE_ATOMIC_H_
+#define _OE_PROPERTY_TREE_ATOMIC_H_
+
+namespace OpenEngine {
+namespace Utils {
+
+/**
+ * Integer shared between threads. All operations are full memory
+ * barriers (gcc __sync builtins).
+ *
+ * @class AtomicInt Atomic.h ons/PropertyTree/Utils/Atomic.h
+ */
+class AtomicInt {
+private:
+    volatile int value;
+public:
+    AtomicInt(int v = 0) : value(v) {}
+
+    int Get() const {
+        __sync_synchronize();
+        return value;
+    }
+
+    void Set(int v) {
+        __sync_synchronize();
+        value = v;
+        __sync_synchronize();
+    }
+
+    bool CompareAndSwap(int expected, int desired) {
+        return __sync_bool_compare_and_swap(&value, expected, desired);
+    }
+
+    int Increment() {
+        return __sync_add_and_fetch(&value, 1);
+    }
+
+    int Decrement() {
+        return __sync_sub_and_fetch(&value, 1);
+    }
+};
+
+/**
+ * Pointer shared between threads, same guarantees as AtomicInt.
+ *
+ * @class AtomicPointer Atomic.h ons/PropertyTree/Utils/Atomic.h
+ */
+template <class T>
+class AtomicPointer {
+private:
+    T* volatile value;
+public:
+    AtomicPointer(T* v = 0) : value(v) {}
+
+    T* Get() const {
+        __sync_synchronize();
+        return value;
+    }
+
+    void Set(T* v) {
+        __sync_synchronize();
+        value = v;
+        __sync_synchronize();
+    }
+
+    bool CompareAndSwap(T* expected, T* desired) {
+        return __sync_bool_compare_and_swap(&value, expected, desired);
+    }
+};
+
+} // NS Utils
+} // NS OpenEngine
+
+#endif // _OE_PROPERTY_TREE_ATOMIC_H_
@@ -0,0 +1,130 @@
+//
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "FileWatcher.h"
+
+#include <Logging/Logger.h>
+#include <Resources/File.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#define SleepMillis(ms) Sleep(ms)
+#else
+#include <unistd.h>
+#define SleepMillis(ms) usleep((ms) * 1000)
+#endif
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace std;
+
+// how often the watcher thread checks if it should stop
+static const int STOP_INTERVAL = 250;
+// timestamp polling interval for the fallback watcher
+static const int POLL_INTERVAL = 1000;
+
+FileWatcher::FileWatcher(string file)
+    : filename(file)
+    , changed(0)
+    , running(1)
+    , inotifyFd(-1) {
+    string::size_type slash = file.find_last_of("/");
+    if (slash == string::npos) {
+        dir = ".";
+        base = file;
+    } else {
+        dir = file.substr(0, slash + 1);
+        base = file.substr(slash + 1);
+    }
+}
+
+FileWatcher::~FileWatcher() {
+    Stop();
+}
+
+void FileWatcher::Stop() {
+    if (running.CompareAndSwap(1, 0))
+        Wait();
+}
+
+void FileWatcher::Run() {
+    if (!WatchInotify())
+        WatchTimestamp();
+}
+
+#ifdef __linux__
+bool FileWatcher::WatchInotify() {
+    inotifyFd = inotify_init();
+    if (inotifyFd < 0)
+        return false;
+    // watch the directory, editors often replace the file itself
+    if (inotify_add_watch(inotifyFd, dir.c_str(),
+                          IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        logger.warning << "FileWatcher: could not watch " << dir 
+                       << ", falling back to polling" << logger.end;
+        close(inotifyFd);
+        inotifyFd = -1;
+        return false;
+    }
+
+    char buffer[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd;
+    pfd.fd = inotifyFd;
+    pfd.events = POLLIN;
+
+    while (running.Get()) {
+        if (poll(&pfd, 1, STOP_INTERVAL) <= 0)
+            continue;
+        ssize_t len = read(inotifyFd, buffer, sizeof(buffer));
+        if (len <= 0)
+            continue;
+        for (char* p = buffer; p < buffer + len; ) {
+            struct inotify_event* event = (struct inotify_event*)p;
+            if (event->len && base.compare(event->name) == 0)
+                changed.Set(1);
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    close(inotifyFd);
+    inotifyFd = -1;
+    return true;
+}
+#else
+bool FileWatcher::WatchInotify() {
+    return false;
+}
+#endif
+
+void FileWatcher::WatchTimestamp() {
+    DateTime lastTimestamp = Resources::File::GetLastModified(filename);
+    int elapsed = 0;
+    while (running.Get()) {
+        SleepMillis(STOP_INTERVAL);
+        elapsed += STOP_INTERVAL;
+        if (elapsed < POLL_INTERVAL)
+            continue;
+        elapsed = 0;
+        DateTime newTimestamp = Resources::File::GetLastModified(filename);
+        if (newTimestamp != lastTimestamp) {
+            lastTimestamp = newTimestamp;
+            changed.Set(1);
+        }
+    }
+}
+
+} // NS Utils
+} // NS OpenEngine
@@ -0,0 +1,65 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+
+#ifndef _OE_PROPERTY_FILE_WATCHER_H_
+#define _OE_PROPERTY_FILE_WATCHER_H_
+
+#include "Atomic.h"
+#include <string>
+#include <Core/Thread.h>
+#include <Utils/DateTime.h>
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace std;
+
+/**
+ * Watches a single file from a background thread.
+ *
+ * On Linux the directory holding the file is watched with inotify,
+ * so both in place writes (truncate and write) and editors that
+ * write a new file and rename it over the old one are seen once the
+ * file has been closed. Elsewhere, or if inotify is unavailable, the
+ * thread falls back to checking the modification time once a
+ * second. Either way the owner only has to test a flag.
+ *
+ * @class FileWatcher FileWatcher.h ons/PropertyTree/Utils/FileWatcher.h
+ */
+class FileWatcher : public Core::Thread {
+private:
+    string filename;
+    string dir;
+    string base;
+    AtomicInt changed;
+    AtomicInt running;
+    int inotifyFd;
+
+    bool WatchInotify();
+    void WatchTimestamp();
+public:
+    FileWatcher(string file);
+    virtual ~FileWatcher();
+
+    void Run();
+    void Stop();
+
+    /**
+     * True if the file changed since the last call.
+     */
+    bool HasChanged() {
+        return changed.Get() && changed.CompareAndSwap(1, 0);
+    }
+};
+
+} // NS Utils
+} // NS OpenEngine
+
+#endif // _OE_PROPERTY_FILE_WATCHER_H_
@@ -0,0 +1,156 @@
+//
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "PropertyAtomTable.h"
+#include <algorithm>
+#include <cstring>
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace std;
+
+PropertyAtomTable::PropertyAtomTable()
+    : index(64, -1)
+    , mask(63)
+    , values(0)
+    , sweepAt(256) {
+    stats.atoms = 0;
+    stats.atomBytes = 0;
+    stats.references = 0;
+    stats.referenceBytes = 0;
+}
+
+PropertyAtomTable::~PropertyAtomTable() {
+    for (vector<PropertyAtom*>::iterator itr = atoms.begin();
+         itr != atoms.end();
+         itr++) {
+        delete *itr;
+    }
+}
+
+// FNV-1a
+unsigned int PropertyAtomTable::Hash(const char* key, size_t len) {
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+PropertyAtom* PropertyAtomTable::Find(const char* key, size_t len,
+                                      unsigned int hash) const {
+    for (unsigned int i = hash & mask; index[i] >= 0; i = (i + 1) & mask) {
+        PropertyAtom* a = atoms[index[i]];
+        if (a->hash == hash && a->str.size() == len 
+            && memcmp(a->str.data(), key, len) == 0)
+            return a;
+    }
+    return NULL;
+}
+
+void PropertyAtomTable::Grow() {
+    index.resize(index.size() * 2);
+    mask = index.size() - 1;
+    Rehash();
+}
+
+void PropertyAtomTable::Rehash() {
+    index.assign(index.size(), -1);
+    for (unsigned int id = 0; id < atoms.size(); id++) {
+        if (!atoms[id])
+            continue;
+        unsigned int i = atoms[id]->hash & mask;
+        while (index[i] >= 0)
+            i = (i + 1) & mask;
+        index[i] = id;
+    }
+}
+
+/**
+ * Deletes the value atoms no value refers to. Values only take
+ * references through this table or from values that hold one, so a
+ * count of zero stays zero.
+ */
+void PropertyAtomTable::Sweep() {
+    for (unsigned int id = 0; id < atoms.size(); id++) {
+        PropertyAtom* a = atoms[id];
+        if (!a || a->key || a->refs.Get() > 0)
+            continue;
+        stats.atoms--;
+        stats.atomBytes -= a->str.size();
+        values--;
+        delete a;
+        atoms[id] = NULL;
+        freeIds.push_back(id);
+    }
+    Rehash();
+    sweepAt = max(256u, values * 2);
+}
+
+PropertyAtom* PropertyAtomTable::Insert(const char* key, size_t len,
+                                        unsigned int hash) {
+    PropertyAtom* a = new PropertyAtom();
+    a->str.assign(key, len);
+    a->hash = hash;
+    a->table = this;
+    if (freeIds.empty()) {
+        a->id = atoms.size();
+        atoms.push_back(a);
+    } else {
+        a->id = freeIds.back();
+        freeIds.pop_back();
+        atoms[a->id] = a;
+    }
+    stats.atoms++;
+    stats.atomBytes += len;
+
+    if (atoms.size() * 2 > index.size()) {
+        Grow();
+    } else {
+        unsigned int i = hash & mask;
+        while (index[i] >= 0)
+            i = (i + 1) & mask;
+        index[i] = a->id;
+    }
+    return a;
+}
+
+const PropertyAtom* PropertyAtomTable::Intern(const char* key, size_t len) {
+    stats.references++;
+    stats.referenceBytes += len;
+
+    unsigned int hash = Hash(key, len);
+    PropertyAtom* a = Find(key, len, hash);
+    if (!a)
+        a = Insert(key, len, hash);
+    else if (!a->key)
+        values--;
+    // keys are never swept
+    a->key = true;
+    return a;
+}
+
+const PropertyAtom* PropertyAtomTable::InternValue(const char* value, size_t len) {
+    stats.references++;
+    stats.referenceBytes += len;
+
+    unsigned int hash = Hash(value, len);
+    PropertyAtom* a = Find(value, len, hash);
+    if (a)
+        return a;
+    if (values >= sweepAt)
+        Sweep();
+    values++;
+    return Insert(value, len, hash);
+}
+
+} // NS Utils
+} // NS OpenEngine
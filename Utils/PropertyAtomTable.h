@@ -0,0 +1,132 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+
+#ifndef _OE_PROPERTY_ATOM_TABLE_H_
+#define _OE_PROPERTY_ATOM_TABLE_H_
+
+#include "Atomic.h"
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace std;
+
+class PropertyAtomTable;
+
+/**
+ * Interned string. There is exactly one atom per distinct string in
+ * a table, so atoms from the same table can be compared by pointer
+ * or id.
+ *
+ * Values count their references to an atom. Atoms without a table
+ * belong to the values alone and are deleted with the last one.
+ */
+struct PropertyAtom {
+    string str;
+    unsigned int id;
+    unsigned int hash;
+    bool key;
+    const PropertyAtomTable* table;
+    // values may be released on reader threads
+    mutable AtomicInt refs;
+
+    PropertyAtom() : id(0), hash(0), key(false), table(NULL) {}
+
+    static const PropertyAtom* Retain(const PropertyAtom* a) {
+        a->refs.Increment();
+        return a;
+    }
+    static void Release(const PropertyAtom* a) {
+        // a table atom may be swept as soon as its count is zero
+        bool owned = a->table == NULL;
+        if (a->refs.Decrement() == 0 && owned)
+            delete a;
+    }
+};
+
+/**
+ * Per tree table of interned keys and short scalar values.
+ *
+ * Key atoms live as long as the table, their addresses and ids are
+ * stable. Value atoms no value refers to any more are swept when
+ * the number of value atoms has doubled since the last sweep, so
+ * edited values that are loaded again and again do not grow the
+ * table without bound. Sweeping and interning happen on the thread
+ * that owns the tree.
+ *
+ * @class PropertyAtomTable PropertyAtomTable.h ons/PropertyTree/Utils/PropertyAtomTable.h
+ */
+class PropertyAtomTable {
+public:
+    // longer scalar values are not worth interning
+    static const unsigned int MAX_VALUE_LENGTH = 32;
+
+    struct Stats {
+        // distinct atoms and the bytes of text they hold
+        unsigned int atoms;
+        unsigned int atomBytes;
+        // interning requests and the bytes of text they asked for,
+        // the difference to atomBytes is what sharing saved
+        unsigned int references;
+        unsigned int referenceBytes;
+    };
+private:
+    // NULL where a value atom was swept, its id is reused
+    vector<PropertyAtom*> atoms;
+    vector<unsigned int> freeIds;
+    vector<int> index;
+    unsigned int mask;
+    unsigned int values, sweepAt;
+    Stats stats;
+
+    static unsigned int Hash(const char* key, size_t len);
+    void Grow();
+    void Rehash();
+    void Sweep();
+    PropertyAtom* Find(const char* key, size_t len, unsigned int hash) const;
+    PropertyAtom* Insert(const char* key, size_t len, unsigned int hash);
+public:
+    PropertyAtomTable();
+    ~PropertyAtomTable();
+
+    const PropertyAtom* Find(const char* key, size_t len) const {
+        return Find(key, len, Hash(key, len));
+    }
+    const PropertyAtom* Find(const string& key) const {
+        return Find(key.data(), key.size());
+    }
+
+    const PropertyAtom* Intern(const char* key, size_t len);
+    const PropertyAtom* Intern(const string& key) {
+        return Intern(key.data(), key.size());
+    }
+
+    // The atom must be retained by a value before the next call
+    const PropertyAtom* InternValue(const char* value, size_t len);
+    const PropertyAtom* InternValue(const string& value) {
+        return InternValue(value.data(), value.size());
+    }
+
+    const PropertyAtom* GetAtom(unsigned int id) const {
+        return atoms[id];
+    }
+
+    Stats GetStats() const {
+        return stats;
+    }
+};
+
+} // NS Utils
+} // NS OpenEngine
+
+#endif // _OE_PROPERTY_ATOM_TABLE_H_
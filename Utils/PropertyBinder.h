@@ -12,13 +12,22 @@
 #define _OE_PROPERTY_BINDER_H_
 
 #include <Core/IListener.h>
-#include <Utils/PropertyTree.h>
+#include <Utils/PropertyTreeNode.h>
 
 namespace OpenEngine {
 namespace Utils {
 
 /**
- * Short description.
+ * Calls a setter on an instance whenever the value of a node changes.
+ *
+ * The binder remembers the version of the node and the value it last
+ * delivered. Events that cannot change the value (TYPE only), events
+ * where the node version did not move and values equal to the last
+ * one delivered are skipped, so the setter only sees real changes.
+ *
+ * The binder holds the node. If the node is removed from the tree it
+ * stays valid but the setter is no longer called. Binders must be
+ * destroyed before their tree.
  *
  * @class PropertyBinder PropertyBinder.h ons/PropertyTree/Utils/PropertyBinder.h
  */
@@ -29,6 +38,10 @@ private:
     C& instance;
     T def;
     void (C::*setFunc)(T);
+    T last;
+    unsigned int version;
+    PropertyBinder(const PropertyBinder&);
+    PropertyBinder& operator=(const PropertyBinder&);
 public:
     PropertyBinder(PropertyTreeNode* n,
                    C& inst,
@@ -37,15 +50,87 @@ public:
         : node(n)
         , instance(inst)
         , def(def)
-        , setFunc(sFun) {
+        , setFunc(sFun)
+        , version(0) {
+        node->Retain();
         node->PropertiesChangedEvent().Attach(*this);
-        (instance.*setFunc)(node->Get<T>(def));
+        last = node->Get<T>(def);
+        version = node->GetSubtreeVersion();
+        (instance.*setFunc)(last);
+    }
+
+    ~PropertyBinder() {
+        node->PropertiesChangedEvent().Detach(*this);
+        node->Release();
     }
 
     void Handle(PropertiesChangedEventArg arg) {
-        (instance.*setFunc)(node->Get<T>(def));
+        if (!arg.IsValueChange() && !arg.IsStructureChange())
+            return;
+        if (node->IsRemoved())
+            return;
+        T val = def;
+        if (!node->GetIfChanged(version, val) || val == last)
+            return;
+        last = val;
+        (instance.*setFunc)(last);
     }
 };
+
+/**
+ * Polled binder with the setter fixed at compile time.
+ *
+ * Nothing is attached to the node. The owner calls Update, typically
+ * once per frame, which costs a version compare when nothing changed
+ * and a direct, inlinable call of the setter when something did.
+ * The node is held like by PropertyBinder.
+ *
+ * @code
+ * StaticPropertyBinder<Light, float, &Light::SetIntensity> intensity(node, light, 1.0);
+ * ...
+ * intensity.Update();
+ * @endcode
+ *
+ * @class StaticPropertyBinder PropertyBinder.h ons/PropertyTree/Utils/PropertyBinder.h
+ */
+template <class C, class T, void (C::*Setter)(T)>
+class StaticPropertyBinder {
+private:
+    PropertyTreeNode* node;
+    C& instance;
+    T def;
+    T last;
+    unsigned int version;
+    StaticPropertyBinder(const StaticPropertyBinder&);
+    StaticPropertyBinder& operator=(const StaticPropertyBinder&);
+public:
+    StaticPropertyBinder(PropertyTreeNode* n, C& inst, T def)
+        : node(n)
+        , instance(inst)
+        , def(def)
+        , version(0) {
+        node->Retain();
+        last = node->Get<T>(def);
+        version = node->GetSubtreeVersion();
+        (instance.*Setter)(last);
+    }
+
+    ~StaticPropertyBinder() {
+        node->Release();
+    }
+
+    bool Update() {
+        if (node->IsRemoved())
+            return false;
+        T val = def;
+        if (!node->GetIfChanged(version, val) || val == last)
+            return false;
+        last = val;
+        (instance.*Setter)(last);
+        return true;
+    }
+};
+
 } // NS Utils
 } // NS OpenEngine
 
@@ -0,0 +1,222 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "PropertyIndex.h"
+#include "PropertyTreeNode.h"
+#include <algorithm>
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace std;
+
+PropertyIndex::PropertyIndex(PropertyTreeNode* n, const PropertyAtom* key)
+    : node(n)
+    , key(key)
+    , version(0)
+    , columnar(false)
+    , built(false)
+    , numeric(true)
+    , textKeys(0) {
+}
+
+const string& PropertyIndex::GetKeyName() const {
+    return key->str;
+}
+
+unsigned int PropertyIndex::GetSize() {
+    Update();
+    return numeric ? numbers.size() : texts.size();
+}
+
+/**
+ * The version of the key column of a RECORDS node, the subtree
+ * version of other arrays. The two are counted apart, so columnar
+ * tells which one it is.
+ */
+unsigned int PropertyIndex::GetVersion(bool& columnar) const {
+    columnar = false;
+    if (node->IsRecords()) {
+        int c = node->records->FindColumn(key);
+        if (c >= 0) {
+            columnar = true;
+            return node->records->GetColumn(c).version;
+        }
+    }
+    return node->GetSubtreeVersion();
+}
+
+void PropertyIndex::Update() {
+    bool c;
+    unsigned int v = GetVersion(c);
+    if (!built || v != version || c != columnar)
+        Rebuild();
+}
+
+void PropertyIndex::Rebuild() {
+    version = GetVersion(columnar);
+    built = true;
+    numbers.clear();
+    texts.clear();
+    unsigned int size = node->IsArray() ? node->GetSize() : 0;
+    vector<pair<unsigned int, PropertyValue> > keys;
+    keys.reserve(size);
+    numeric = true;
+    for (unsigned int i = 0; i < size; i++) {
+        PropertyValue v;
+        if (!GetKey(i, v))
+            continue;
+        numeric &= v.GetType() != PropertyTree::STRING;
+        keys.push_back(make_pair(i, v));
+    }
+    if (numeric) {
+        numbers.resize(keys.size());
+        for (unsigned int i = 0; i < keys.size(); i++) {
+            numbers[i].key = keys[i].second.As<double>();
+            numbers[i].row = keys[i].first;
+        }
+        sort(numbers.begin(), numbers.end());
+    } else {
+        texts.resize(keys.size());
+        textKeys = 0;
+        for (unsigned int i = 0; i < keys.size(); i++) {
+            texts[i].key = keys[i].second.ToString();
+            texts[i].row = keys[i].first;
+            texts[i].number = keys[i].second.GetType() != PropertyTree::STRING;
+            if (!texts[i].number)
+                textKeys++;
+        }
+        sort(texts.begin(), texts.end());
+    }
+}
+
+/**
+ * Moves the entry of a row whose key changed. Returns false if the
+ * index must be rebuilt instead, because it would change between
+ * numbers and text.
+ */
+bool PropertyIndex::UpdateRow(unsigned int row) {
+    PropertyValue v;
+    bool found = GetKey(row, v);
+    if (found && numeric && v.GetType() == PropertyTree::STRING)
+        return false;
+    if (numeric) {
+        for (unsigned int i = 0; i < numbers.size(); i++) {
+            if (numbers[i].row == row) {
+                numbers.erase(numbers.begin() + i);
+                break;
+            }
+        }
+        if (found) {
+            NumberEntry e = {v.As<double>(), row};
+            numbers.insert(lower_bound(numbers.begin(), numbers.end(), e), e);
+        }
+        return true;
+    }
+    bool number = v.GetType() != PropertyTree::STRING;
+    unsigned int i = 0;
+    while (i < texts.size() && texts[i].row != row)
+        i++;
+    if (i < texts.size() && !texts[i].number)
+        textKeys--;
+    if (found && !number)
+        textKeys++;
+    if (!textKeys)
+        return false;
+    if (i < texts.size())
+        texts.erase(texts.begin() + i);
+    if (found) {
+        TextEntry e = {v.ToString(), row, number};
+        texts.insert(lower_bound(texts.begin(), texts.end(), e), e);
+    }
+    return true;
+}
+
+/**
+ * The key of a record, read without creating nodes. Text that is a
+ * number is turned into one.
+ */
+bool PropertyIndex::GetKey(unsigned int row, PropertyValue& v) const {
+    if (node->IsRecords()) {
+        const PropertyRecordTable& table = *node->records;
+        int c = table.FindColumn(key);
+        if (c < 0 || table.GetColumn(c).kind == PropertyColumn::TUPLE)
+            return false;
+        v = table.GetColumn(c).GetValue(row);
+    } else {
+        const PropertyTreeNode* record = node->FindIdx(row);
+        const PropertyTreeNode* n = record ? record->subNodes.Find(key) : NULL;
+        if (!n || n->kind != PropertyTreeNode::SCALAR || !n->isSet)
+            return false;
+        v = n->value;
+    }
+    if (v.GetType() == PropertyTree::STRING) {
+        PropertyValue number = v;
+        if (number.ConvertTo(PropertyTree::DOUBLE))
+            v = number;
+    }
+    return v.IsSet();
+}
+
+int PropertyIndex::FindRow(PropertyValue v) {
+    Update();
+    if (numeric) {
+        if (v.GetType() == PropertyTree::STRING &&
+            !v.ConvertTo(PropertyTree::DOUBLE))
+            return -1;
+        NumberEntry e = {v.As<double>(), 0};
+        vector<NumberEntry>::iterator itr =
+            lower_bound(numbers.begin(), numbers.end(), e);
+        if (itr == numbers.end() || itr->key != e.key)
+            return -1;
+        return itr->row;
+    }
+    TextEntry e = {v.ToString(), 0, false};
+    vector<TextEntry>::iterator itr = lower_bound(texts.begin(), texts.end(), e);
+    if (itr == texts.end() || itr->key != e.key)
+        return -1;
+    return itr->row;
+}
+
+PropertyTreeNode* PropertyIndex::FindRecord(int row) {
+    if (row < 0)
+        return NULL;
+    return node->GetNodeIdx(row);
+}
+
+void PropertyIndex::FindAll(const PropertyValue& val, vector<PropertyTreeNode*>& out) {
+    PropertyValue v = val;
+    Update();
+    if (numeric) {
+        if (v.GetType() == PropertyTree::STRING &&
+            !v.ConvertTo(PropertyTree::DOUBLE))
+            return;
+        FindRange(v.As<double>(), v.As<double>(), out);
+        return;
+    }
+    TextEntry e = {v.ToString(), 0, false};
+    for (vector<TextEntry>::iterator itr = lower_bound(texts.begin(), texts.end(), e);
+         itr != texts.end() && itr->key == e.key;
+         itr++)
+        out.push_back(node->GetNodeIdx(itr->row));
+}
+
+void PropertyIndex::FindRange(double low, double high, vector<PropertyTreeNode*>& out) {
+    Update();
+    if (!numeric)
+        return;
+    NumberEntry e = {low, 0};
+    for (vector<NumberEntry>::iterator itr = lower_bound(numbers.begin(), numbers.end(), e);
+         itr != numbers.end() && itr->key <= high;
+         itr++)
+        out.push_back(node->GetNodeIdx(itr->row));
+}
+
+} // NS Utils
+} // NS OpenEngine
@@ -0,0 +1,134 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+
+#ifndef _OE_PROPERTY_INDEX_H_
+#define _OE_PROPERTY_INDEX_H_
+
+#include "PropertyTree.h"
+#include "PropertyValue.h"
+#include <vector>
+#include <string>
+
+namespace OpenEngine {
+namespace Utils {
+
+class PropertyTreeNode;
+struct PropertyAtom;
+
+using namespace std;
+
+/**
+ * Lookup of the records of an array by the value of one of their
+ * keys.
+ *
+ * The index keeps the records sorted by key, as numbers if every key
+ * is a number and as text otherwise, so lookups are binary searches.
+ * It remembers the subtree version of the array it was built for and
+ * is rebuilt by the first lookup after the array changed. A changed
+ * value only moves the entry of its record if it is the key, so
+ * only changes of structure or type rebuild it. For RECORDS nodes it
+ * follows the version of the key column instead, so changes to the
+ * other keys do not rebuild it. Records without the key are
+ * not indexed. Several records with the same key are kept in array
+ * order.
+ *
+ * Indexes are created and owned by the tree, see
+ * PropertyTreeNode::CreateIndex.
+ *
+ * @code
+ * PropertyIndex* byId = items->CreateIndex("id");
+ * PropertyTreeNode* item = byId->Find(42);
+ * vector<PropertyTreeNode*> near;
+ * items->CreateIndex("x")->FindRange(-10.0, 10.0, near);
+ * @endcode
+ *
+ * @class PropertyIndex PropertyIndex.h ons/PropertyTree/Utils/PropertyIndex.h
+ */
+class PropertyIndex {
+    friend class PropertyTree;
+private:
+    struct NumberEntry {
+        double key;
+        unsigned int row;
+        bool operator<(const NumberEntry& other) const {
+            return key < other.key || (key == other.key && row < other.row);
+        }
+    };
+    struct TextEntry {
+        string key;
+        unsigned int row;
+        // numbers are kept as text while other keys are text
+        bool number;
+        bool operator<(const TextEntry& other) const {
+            int c = key.compare(other.key);
+            return c < 0 || (c == 0 && row < other.row);
+        }
+    };
+
+    PropertyTreeNode* node;
+    const PropertyAtom* key;
+    unsigned int version;
+    bool columnar;
+    bool built;
+    bool numeric;
+    // text entries that are not numbers
+    unsigned int textKeys;
+    vector<NumberEntry> numbers;
+    vector<TextEntry> texts;
+
+    PropertyIndex(PropertyTreeNode* n, const PropertyAtom* key);
+
+    unsigned int GetVersion(bool& columnar) const;
+    void Update();
+    void Rebuild();
+    bool UpdateRow(unsigned int row);
+    bool GetKey(unsigned int row, PropertyValue& v) const;
+    int FindRow(PropertyValue v);
+    PropertyTreeNode* FindRecord(int row);
+public:
+    const string& GetKeyName() const;
+    unsigned int GetSize();
+
+    // The first record with the key, or NULL
+    template <class T>
+    PropertyTreeNode* Find(T val) {
+        PropertyValue v;
+        v.Store(val);
+        return FindRecord(FindRow(v));
+    }
+
+    // Array position of the first record with the key, or -1
+    template <class T>
+    int FindIdx(T val) {
+        PropertyValue v;
+        v.Store(val);
+        return FindRow(v);
+    }
+
+    // Every record with the key
+    template <class T>
+    void FindAll(T val, vector<PropertyTreeNode*>& out) {
+        PropertyValue v;
+        v.Store(val);
+        FindAll(v, out);
+    }
+    void FindAll(const PropertyValue& v, vector<PropertyTreeNode*>& out);
+
+    /**
+     * Appends the records with a number key in [low, high], ordered
+     * by key. Indexes with text keys find nothing.
+     */
+    void FindRange(double low, double high, vector<PropertyTreeNode*>& out);
+};
+
+} // NS Utils
+} // NS OpenEngine
+
+#endif // _OE_PROPERTY_INDEX_H_
@@ -0,0 +1,141 @@
+//
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "PropertyNodeMap.h"
+#include <algorithm>
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace std;
+
+// atom ids are sequential, spread them over the table
+unsigned int PropertyNodeMap::Hash(const PropertyAtom* key) {
+    return key->id * 2654435761u;
+}
+
+bool PropertyNodeMap::Less(const Entry* a, const Entry* b) {
+    return a->first->str < b->first->str;
+}
+
+int PropertyNodeMap::FindEntry(const PropertyAtom* key) const {
+    if (index.empty()) {
+        unsigned int lo = 0, hi = entries.size();
+        while (lo < hi) {
+            unsigned int mid = (lo + hi) / 2;
+            unsigned int id = entries[mid].first->id;
+            if (id == key->id)
+                return mid;
+            if (id < key->id)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return -1;
+    }
+    for (unsigned int i = Hash(key) & mask; index[i] >= 0; i = (i + 1) & mask) {
+        if (entries[index[i]].first == key)
+            return index[i];
+    }
+    return -1;
+}
+
+unsigned int PropertyNodeMap::FindSlot(int entry) const {
+    unsigned int i = Hash(entries[entry].first) & mask;
+    while (index[i] != entry)
+        i = (i + 1) & mask;
+    return i;
+}
+
+void PropertyNodeMap::BuildIndex(unsigned int capacity) {
+    index.assign(capacity, -1);
+    mask = capacity - 1;
+    for (unsigned int e = 0; e < entries.size(); e++)
+        IndexInsert(e);
+}
+
+void PropertyNodeMap::IndexInsert(int entry) {
+    unsigned int i = Hash(entries[entry].first) & mask;
+    while (index[i] >= 0)
+        i = (i + 1) & mask;
+    index[i] = entry;
+}
+
+void PropertyNodeMap::IndexErase(int entry) {
+    // backward shift deletion, keeps probe sequences intact without
+    // tombstones
+    unsigned int i = FindSlot(entry);
+    unsigned int j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (index[j] < 0)
+            break;
+        unsigned int home = Hash(entries[index[j]].first) & mask;
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+            continue;
+        index[i] = index[j];
+        i = j;
+    }
+    index[i] = -1;
+}
+
+void PropertyNodeMap::Insert(const PropertyAtom* key, PropertyTreeNode* n) {
+    if (index.empty()) {
+        iterator itr = entries.begin();
+        unsigned int lo = 0, hi = entries.size();
+        while (lo < hi) {
+            unsigned int mid = (lo + hi) / 2;
+            if (entries[mid].first->id < key->id)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        entries.insert(itr + lo, make_pair(key, n));
+        if (entries.size() > HASH_THRESHOLD)
+            BuildIndex(HASH_THRESHOLD * 4);
+        return;
+    }
+    entries.push_back(make_pair(key, n));
+    if (entries.size() * 2 > index.size())
+        BuildIndex(index.size() * 2);
+    else
+        IndexInsert(entries.size() - 1);
+}
+
+PropertyNodeMap::iterator PropertyNodeMap::erase(iterator itr) {
+    if (index.empty())
+        return entries.erase(itr);
+
+    int e = itr - entries.begin();
+    int last = entries.size() - 1;
+    IndexErase(e);
+    if (e != last) {
+        index[FindSlot(last)] = e;
+        entries[e] = entries[last];
+    }
+    entries.pop_back();
+    return entries.begin() + e;
+}
+
+void PropertyNodeMap::clear() {
+    entries.clear();
+    index.clear();
+    mask = 0;
+}
+
+void PropertyNodeMap::GetSorted(vector<Entry*>& out) {
+    out.clear();
+    out.reserve(entries.size());
+    for (iterator itr = entries.begin(); itr != entries.end(); itr++)
+        out.push_back(&*itr);
+    sort(out.begin(), out.end(), Less);
+}
+
+} // NS Utils
+} // NS OpenEngine
@@ -0,0 +1,83 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+
+#ifndef _OE_PROPERTY_NODE_MAP_H_
+#define _OE_PROPERTY_NODE_MAP_H_
+
+#include "PropertyAtomTable.h"
+#include <vector>
+
+namespace OpenEngine {
+namespace Utils {
+
+class PropertyTreeNode;
+
+using namespace std;
+
+/**
+ * Child container for map nodes.
+ *
+ * Children are keyed by atoms from the tree's atom table, so lookups
+ * only compare atom ids. Small maps are kept as a vector sorted by
+ * atom id and searched with a binary search. Above HASH_THRESHOLD
+ * entries an open addressing (linear probing) index is added on top
+ * of the vector, and the entries are no longer kept sorted. Use
+ * GetSorted for a deterministic (key ordered) iteration order. A map
+ * stays hashed until it is cleared.
+ *
+ * @class PropertyNodeMap PropertyNodeMap.h ons/PropertyTree/Utils/PropertyNodeMap.h
+ */
+class PropertyNodeMap {
+public:
+    typedef pair<const PropertyAtom*, PropertyTreeNode*> Entry;
+    typedef vector<Entry>::iterator iterator;
+    typedef vector<Entry>::const_iterator const_iterator;
+
+    static const unsigned int HASH_THRESHOLD = 32;
+private:
+    vector<Entry> entries;
+    vector<int> index;
+    unsigned int mask;
+
+    static unsigned int Hash(const PropertyAtom* key);
+    static bool Less(const Entry* a, const Entry* b);
+    int FindEntry(const PropertyAtom* key) const;
+    unsigned int FindSlot(int entry) const;
+    void BuildIndex(unsigned int capacity);
+    void IndexInsert(int entry);
+    void IndexErase(int entry);
+public:
+    PropertyNodeMap() : mask(0) {}
+
+    PropertyTreeNode* Find(const PropertyAtom* key) const {
+        int e = FindEntry(key);
+        return (e < 0) ? NULL : entries[e].second;
+    }
+
+    // key must not be present already
+    void Insert(const PropertyAtom* key, PropertyTreeNode* n);
+    // returns the position of the next entry to visit
+    iterator erase(iterator itr);
+    void clear();
+
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.end(); }
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+    unsigned int size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+
+    void GetSorted(vector<Entry*>& out);
+};
+
+} // NS Utils
+} // NS OpenEngine
+
+#endif // _OE_PROPERTY_NODE_MAP_H_
@@ -0,0 +1,54 @@
+//
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "PropertyNodePool.h"
+#include <new>
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace std;
+
+PropertyNodePool::PropertyNodePool(size_t size)
+    : nodeSize(size < sizeof(void*) ? sizeof(void*) : size)
+    , used(CHUNK_SIZE)
+    , freeList(NULL)
+    , live(0) {
+}
+
+PropertyNodePool::~PropertyNodePool() {
+    for (vector<char*>::iterator itr = chunks.begin();
+         itr != chunks.end();
+         itr++) {
+        ::operator delete(*itr);
+    }
+}
+
+void* PropertyNodePool::Allocate() {
+    live++;
+    if (freeList) {
+        void* p = freeList;
+        freeList = *(void**)p;
+        return p;
+    }
+    if (used == CHUNK_SIZE) {
+        chunks.push_back((char*)::operator new(nodeSize * CHUNK_SIZE));
+        used = 0;
+    }
+    return chunks.back() + nodeSize * used++;
+}
+
+void PropertyNodePool::Free(void* p) {
+    live--;
+    *(void**)p = freeList;
+    freeList = p;
+}
+
+} // NS Utils
+} // NS OpenEngine
@@ -0,0 +1,59 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+
+#ifndef _OE_PROPERTY_NODE_POOL_H_
+#define _OE_PROPERTY_NODE_POOL_H_
+
+#include <vector>
+#include <cstddef>
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace std;
+
+/**
+ * Slab allocator for the nodes of one property tree.
+ *
+ * Memory is taken from the heap in chunks of CHUNK_SIZE nodes, so
+ * nodes created together (as during a load) end up next to each
+ * other. Freed nodes are kept on a free list and handed out again,
+ * and the chunks themselves are only returned to the heap when the
+ * pool is destroyed.
+ *
+ * The pool only deals with raw memory, constructing and destroying
+ * the nodes is up to the owning tree.
+ *
+ * @class PropertyNodePool PropertyNodePool.h ons/PropertyTree/Utils/PropertyNodePool.h
+ */
+class PropertyNodePool {
+public:
+    static const unsigned int CHUNK_SIZE = 512;
+private:
+    size_t nodeSize;
+    vector<char*> chunks;
+    unsigned int used;
+    void* freeList;
+    unsigned int live;
+public:
+    PropertyNodePool(size_t size);
+    ~PropertyNodePool();
+
+    void* Allocate();
+    void Free(void* p);
+
+    unsigned int GetChunkCount() { return chunks.size(); }
+    unsigned int GetLiveCount() { return live; }
+};
+
+} // NS Utils
+} // NS OpenEngine
+
+#endif // _OE_PROPERTY_NODE_POOL_H_
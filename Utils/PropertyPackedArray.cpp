@@ -0,0 +1,168 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "PropertyPackedArray.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace std;
+
+void PropertyPackedArray::Set(const float* data, unsigned int size) {
+    elementType = PropertyTree::FLOAT;
+    floats.assign(data, data + size);
+    ints.clear();
+}
+
+void PropertyPackedArray::Set(const int* data, unsigned int size) {
+    elementType = PropertyTree::INT32;
+    ints.assign(data, data + size);
+    floats.clear();
+}
+
+void PropertyPackedArray::Resize(unsigned int size) {
+    if (elementType == PropertyTree::INT32)
+        ints.resize(size);
+    else
+        floats.resize(size);
+}
+
+bool PropertyPackedArray::Store(unsigned int i, const PropertyValue& v) {
+    if (v.GetType() == PropertyTree::FLOAT)
+        ConvertTo(PropertyTree::FLOAT);
+    else if (v.GetType() != PropertyTree::INT32)
+        return false;
+    if (elementType == PropertyTree::INT32)
+        ints[i] = v.As<int>();
+    else
+        floats[i] = v.As<float>();
+    return true;
+}
+
+void PropertyPackedArray::Store(unsigned int offset, const PropertyPackedArray& src) {
+    if (src.elementType == PropertyTree::FLOAT)
+        ConvertTo(PropertyTree::FLOAT);
+    if (elementType == PropertyTree::INT32)
+        copy(src.ints.begin(), src.ints.end(), ints.begin() + offset);
+    else if (src.elementType == PropertyTree::INT32)
+        copy(src.ints.begin(), src.ints.end(), floats.begin() + offset);
+    else
+        copy(src.floats.begin(), src.floats.end(), floats.begin() + offset);
+}
+
+void PropertyPackedArray::Slice(unsigned int offset, unsigned int size,
+                                PropertyPackedArray& out) const {
+    if (elementType == PropertyTree::INT32)
+        out.Set(&ints[offset], size);
+    else
+        out.Set(&floats[offset], size);
+}
+
+bool PropertyPackedArray::Equals(const float* data, unsigned int size) const {
+    return elementType == PropertyTree::FLOAT && floats.size() == size &&
+        equal(floats.begin(), floats.end(), data);
+}
+
+bool PropertyPackedArray::Equals(const int* data, unsigned int size) const {
+    return elementType == PropertyTree::INT32 && ints.size() == size &&
+        equal(ints.begin(), ints.end(), data);
+}
+
+void PropertyPackedArray::Get(PropertySpan<const float>& span) const {
+    if (elementType == PropertyTree::FLOAT && !floats.empty())
+        span = PropertySpan<const float>(&floats[0], floats.size());
+}
+
+void PropertyPackedArray::Get(PropertySpan<const int>& span) const {
+    if (elementType == PropertyTree::INT32 && !ints.empty())
+        span = PropertySpan<const int>(&ints[0], ints.size());
+}
+
+bool PropertyPackedArray::ConvertTo(PropertyTree::PropertyType t) {
+    if (t == elementType)
+        return true;
+    if (t == PropertyTree::FLOAT) {
+        floats.assign(ints.begin(), ints.end());
+        ints.clear();
+    } else if (t == PropertyTree::INT32) {
+        ints.assign(floats.begin(), floats.end());
+        floats.clear();
+    } else
+        return false;
+    elementType = t;
+    return true;
+}
+
+PropertyValue PropertyPackedArray::GetElement(unsigned int i) const {
+    PropertyValue v;
+    if (elementType == PropertyTree::INT32)
+        v.Store(ints[i]);
+    else
+        v.Store(floats[i]);
+    return v;
+}
+
+bool PropertyPackedArray::operator==(const PropertyPackedArray& other) const {
+    return elementType == other.elementType &&
+        floats == other.floats && ints == other.ints;
+}
+
+/**
+ * Packs a sequence of scalar texts. Fails unless every item is a
+ * number. The elements are ints if all items are ints and no float
+ * type is hinted, floats otherwise. Elements are saved as the text of
+ * their value, so it also fails if an item is not written that way,
+ * like 007, 1.10 or a number a float cannot hold. Such sequences keep
+ * the text of every item in element nodes instead.
+ */
+bool PropertyPackedArray::Parse(const vector<string>& items,
+                                PropertyTree::PropertyType hint,
+                                PropertyPackedArray& out) {
+    if (items.empty())
+        return false;
+    bool floatHint = hint == PropertyTree::FLOAT ||
+        hint == PropertyTree::VEC3F || hint == PropertyTree::RGBACOLOR;
+    bool allInts = !floatHint;
+    vector<double> values(items.size());
+    for (unsigned int i = 0; i < items.size(); i++) {
+        const char* s = items[i].c_str();
+        char* end;
+        errno = 0;
+        long l = strtol(s, &end, 10);
+        if (*s && !*end && !errno && l >= INT_MIN && l <= INT_MAX) {
+            values[i] = l;
+            continue;
+        }
+        values[i] = strtod(s, &end);
+        if (!*s || *end)
+            return false;
+        allInts = false;
+    }
+    PropertyPackedArray packed;
+    if (allInts) {
+        packed.elementType = PropertyTree::INT32;
+        packed.ints.assign(values.begin(), values.end());
+    } else
+        packed.floats.assign(values.begin(), values.end());
+    for (unsigned int i = 0; i < items.size(); i++) {
+        if (packed.GetElement(i).ToString() != items[i])
+            return false;
+    }
+    out.elementType = packed.elementType;
+    out.ints.swap(packed.ints);
+    out.floats.swap(packed.floats);
+    return true;
+}
+
+} // NS Utils
+} // NS OpenEngine
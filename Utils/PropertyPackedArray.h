@@ -0,0 +1,99 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+
+#ifndef _OE_PROPERTY_PACKED_ARRAY_H_
+#define _OE_PROPERTY_PACKED_ARRAY_H_
+
+#include "PropertyTree.h"
+#include "PropertyValue.h"
+#include <vector>
+#include <string>
+#include <cstddef>
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace std;
+
+/**
+ * View of contiguous elements owned by someone else. It stays valid
+ * until the owner is changed.
+ */
+template <class E>
+class PropertySpan {
+private:
+    E* data;
+    unsigned int size;
+public:
+    PropertySpan() : data(NULL), size(0) {}
+    PropertySpan(E* d, unsigned int n) : data(d), size(n) {}
+
+    E* begin() const { return data; }
+    E* end() const { return data + size; }
+    E& operator[](unsigned int i) const { return data[i]; }
+    unsigned int GetSize() const { return size; }
+    bool IsEmpty() const { return size == 0; }
+};
+
+/**
+ * Contiguous storage for a numeric sequence, used by PACKED nodes
+ * instead of one child node per element. Elements are either floats
+ * or ints.
+ *
+ * @class PropertyPackedArray PropertyPackedArray.h ons/PropertyTree/Utils/PropertyPackedArray.h
+ */
+class PropertyPackedArray {
+private:
+    PropertyTree::PropertyType elementType;
+    vector<float> floats;
+    vector<int> ints;
+public:
+    PropertyPackedArray() : elementType(PropertyTree::FLOAT) {}
+
+    PropertyTree::PropertyType GetElementType() const { return elementType; }
+    unsigned int GetSize() const {
+        return elementType == PropertyTree::INT32 ? ints.size() : floats.size();
+    }
+
+    void Set(const float* data, unsigned int size);
+    void Set(const int* data, unsigned int size);
+    void Resize(unsigned int size);
+    // Store ints and floats, ints in a float array are widened and
+    // a float turns an int array into floats. Other types fail.
+    bool Store(unsigned int i, const PropertyValue& v);
+    void Store(unsigned int offset, const PropertyPackedArray& src);
+    void Slice(unsigned int offset, unsigned int size,
+               PropertyPackedArray& out) const;
+    bool Equals(const float* data, unsigned int size) const;
+    bool Equals(const int* data, unsigned int size) const;
+
+    // Leave the span empty unless the elements have that type
+    void Get(PropertySpan<const float>& span) const;
+    void Get(PropertySpan<const int>& span) const;
+
+    // Changes the element type, INT32 and FLOAT are supported
+    bool ConvertTo(PropertyTree::PropertyType t);
+
+    PropertyValue GetElement(unsigned int i) const;
+
+    bool operator==(const PropertyPackedArray& other) const;
+    bool operator!=(const PropertyPackedArray& other) const {
+        return !(*this == other);
+    }
+
+    static bool Parse(const vector<string>& items,
+                      PropertyTree::PropertyType hint,
+                      PropertyPackedArray& out);
+};
+
+} // NS Utils
+} // NS OpenEngine
+
+#endif // _OE_PROPERTY_PACKED_ARRAY_H_
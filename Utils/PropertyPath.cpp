@@ -0,0 +1,77 @@
+//
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "PropertyPath.h"
+#include <cstdlib>
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace std;
+
+PropertyPath::PropertyPath(PropertyTree* t, string path)
+    : tree(t)
+    , node(NULL)
+    , generation(0) {
+    Compile(path);
+}
+
+PropertyPath::PropertyPath(PropertyTreeNode* base, string path)
+    : tree(base->GetTree())
+    , node(NULL)
+    , generation(0) {
+    // paths are kept relative to the root, base nodes may be
+    // discarded by a reload while the handle is still alive.
+    Compile(base->GetNodePath());
+    Compile(path);
+}
+
+void PropertyPath::Compile(string path) {
+    using namespace boost;
+    if (path.empty())
+        return;
+    vector<string> parts;
+    split(parts, path, is_any_of("."));
+    for (vector<string>::iterator itr = parts.begin();
+         itr != parts.end();
+         itr++) {
+        keys.push_back(tree->GetAtomTable().Intern(*itr));
+        bool number = !itr->empty() &&
+            itr->find_first_not_of("0123456789") == string::npos;
+        indices.push_back(number ? atoi(itr->c_str()) : -1);
+    }
+}
+
+PropertyTreeNode* PropertyPath::Resolve() {
+    PropertyTreeNode* n = tree->GetRootNode();
+    for (unsigned int i = 0; i < keys.size(); i++) {
+        if (indices[i] >= 0 && n->IsArray())
+            n = n->GetNodeIdx(indices[i]);
+        else
+            n = n->GetNode(keys[i]);
+    }
+    node = n;
+    generation = tree->GetGeneration();
+    return node;
+}
+
+string PropertyPath::GetPath() {
+    string path;
+    for (vector<const PropertyAtom*>::iterator itr = keys.begin();
+         itr != keys.end();
+         itr++) {
+        if (itr != keys.begin())
+            path += ".";
+        path += (*itr)->str;
+    }
+    return path;
+}
+
+} // NS Utils
+} // NS OpenEngine
@@ -0,0 +1,72 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+
+#ifndef _OE_PROPERTY_PATH_H_
+#define _OE_PROPERTY_PATH_H_
+
+#include "PropertyTreeNode.h"
+#include <string>
+#include <vector>
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace std;
+
+/**
+ * Precompiled key path into a property tree.
+ *
+ * The dotted path is split and its keys interned once on
+ * construction, and resolved to a node on first use. The node
+ * pointer is cached and only resolved again when the tree reports
+ * that nodes may have been discarded, so Get and Set on a handle do
+ * no string work. Numeric keys select elements of arrays and map
+ * keys anywhere else.
+ *
+ * @class PropertyPath PropertyPath.h ons/PropertyTree/Utils/PropertyPath.h
+ */
+class PropertyPath {
+private:
+    PropertyTree* tree;
+    vector<const PropertyAtom*> keys;
+    // element index of each key, -1 for keys that are not numbers
+    vector<int> indices;
+    PropertyTreeNode* node;
+    unsigned int generation;
+
+    void Compile(string path);
+    PropertyTreeNode* Resolve();
+public:
+    PropertyPath(PropertyTree* t, string path);
+    PropertyPath(PropertyTreeNode* base, string path);
+
+    PropertyTreeNode* GetNode() {
+        if (node && generation == tree->GetGeneration())
+            return node;
+        return Resolve();
+    }
+
+    template <class T>
+    T Get(T def) {
+        return GetNode()->Get(def);
+    }
+
+    template <class T>
+    void Set(T val) {
+        GetNode()->Set(val);
+    }
+
+    string GetPath();
+};
+
+} // NS Utils
+} // NS OpenEngine
+
+#endif // _OE_PROPERTY_PATH_H_
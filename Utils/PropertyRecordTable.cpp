@@ -0,0 +1,155 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "PropertyRecordTable.h"
+#include "PropertyTreeNode.h"
+#include "Atomic.h"
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace std;
+
+// columns are changed by the loader thread as well
+static AtomicInt columnVersions;
+
+void PropertyColumn::Touch() {
+    version = columnVersions.Increment();
+}
+
+void PropertyColumn::Resize(unsigned int size) {
+    if (kind == VALUE)
+        values.resize(size);
+    else
+        numbers.Resize(size * width);
+    Touch();
+}
+
+/**
+ * Copies a row of src, which must have the same element type. Values
+ * loaded from the same text are the same. Returns true if the row
+ * differed.
+ */
+bool PropertyColumn::Merge(unsigned int row, const PropertyColumn& src) {
+    if (kind == VALUE) {
+        if (values[row].SameText(src.values[row]) ||
+            values[row] == src.values[row])
+            return false;
+        values[row] = src.values[row];
+        Touch();
+        return true;
+    }
+    unsigned int offset = row * width;
+    for (unsigned int i = 0; i < width; i++) {
+        if (numbers.GetElement(offset + i) != src.numbers.GetElement(offset + i)) {
+            PropertyPackedArray tuple;
+            src.numbers.Slice(offset, width, tuple);
+            numbers.Store(offset, tuple);
+            Touch();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PropertyColumn::ConvertTo(PropertyTree::PropertyType t) {
+    PropertyTree::PropertyType from = numbers.GetElementType();
+    if (!numbers.ConvertTo(t))
+        return false;
+    if (numbers.GetElementType() != from)
+        Touch();
+    return true;
+}
+
+void PropertyColumn::ToValues() {
+    unsigned int size = numbers.GetSize();
+    values.resize(size);
+    for (unsigned int i = 0; i < size; i++)
+        values[i] = numbers.GetElement(i);
+    numbers = PropertyPackedArray();
+    kind = VALUE;
+    Touch();
+}
+
+int PropertyRecordTable::FindColumn(const PropertyAtom* key) const {
+    for (unsigned int c = 0; c < columns.size(); c++) {
+        if (columns[c].key == key)
+            return c;
+    }
+    return -1;
+}
+
+bool PropertyRecordTable::SameSchema(const PropertyRecordTable& other) const {
+    if (columns.size() != other.columns.size())
+        return false;
+    for (unsigned int c = 0; c < columns.size(); c++) {
+        const PropertyColumn& a = columns[c];
+        const PropertyColumn& b = other.columns[c];
+        if (a.kind != b.kind || a.width != b.width || a.key->str != b.key->str)
+            return false;
+    }
+    return true;
+}
+
+void PropertyRecordTable::Resize(unsigned int s) {
+    size = s;
+    rows.resize(size, NULL);
+    for (unsigned int c = 0; c < columns.size(); c++)
+        columns[c].Resize(size);
+}
+
+bool PropertyRecordTable::LoadCell(unsigned int row, unsigned int c,
+                                   PropertyTreeNode* cell) const {
+    const PropertyColumn& col = columns[c];
+    cell->isSet = true;
+    if (col.kind == PropertyColumn::TUPLE) {
+        PropertyPackedArray tuple;
+        col.GetTuple(row, tuple);
+        if (cell->packed && *cell->packed == tuple)
+            return false;
+        if (!cell->packed)
+            cell->packed = new PropertyPackedArray();
+        *cell->packed = tuple;
+        cell->kind = PropertyTreeNode::PACKED;
+        return true;
+    }
+    PropertyValue v = col.GetValue(row);
+    if (cell->value == v)
+        return false;
+    cell->value = v;
+    return true;
+}
+
+bool PropertyRecordTable::StoreCell(unsigned int row, unsigned int c,
+                                    const PropertyTreeNode* cell) {
+    PropertyColumn& col = columns[c];
+    if (col.kind == PropertyColumn::TUPLE) {
+        if (cell->kind != PropertyTreeNode::PACKED ||
+            cell->packed->GetSize() != col.width)
+            return false;
+        col.numbers.Store(row * col.width, *cell->packed);
+        col.Touch();
+        return true;
+    }
+    if (cell->kind != PropertyTreeNode::SCALAR)
+        return false;
+    if (col.kind == PropertyColumn::NUMBER) {
+        if (col.numbers.Store(row, cell->value)) {
+            col.Touch();
+            return true;
+        }
+        col.ToValues();
+    }
+    col.values[row] = cell->value;
+    col.Touch();
+    return true;
+}
+
+} // NS Utils
+} // NS OpenEngine
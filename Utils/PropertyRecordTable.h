@@ -0,0 +1,116 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+
+#ifndef _OE_PROPERTY_RECORD_TABLE_H_
+#define _OE_PROPERTY_RECORD_TABLE_H_
+
+#include "PropertyPackedArray.h"
+#include "PropertyAtomTable.h"
+#include <vector>
+
+namespace OpenEngine {
+namespace Utils {
+
+class PropertyTreeNode;
+
+using namespace std;
+
+/**
+ * The values of one key for every record of a table. NUMBER columns
+ * hold one packed number per record, TUPLE columns width numbers per
+ * record and VALUE columns anything else.
+ *
+ * The version of a column changes whenever its values or their type
+ * do and is never shared with another column, so snapshots and
+ * indexes can tell if a column is still the one they copied.
+ *
+ * @class PropertyColumn PropertyRecordTable.h ons/PropertyTree/Utils/PropertyRecordTable.h
+ */
+class PropertyColumn {
+public:
+    enum Kind {NUMBER, TUPLE, VALUE};
+
+    const PropertyAtom* key;
+    Kind kind;
+    unsigned int width;
+    unsigned int version;
+    PropertyPackedArray numbers;
+    vector<PropertyValue> values;
+
+    PropertyColumn(const PropertyAtom* key, Kind kind, unsigned int width)
+        : key(key), kind(kind), width(width) {
+        Touch();
+    }
+
+    PropertyValue GetValue(unsigned int row) const {
+        if (kind == NUMBER)
+            return numbers.GetElement(row);
+        return values[row];
+    }
+    void GetTuple(unsigned int row, PropertyPackedArray& out) const {
+        numbers.Slice(row * width, width, out);
+    }
+
+    void Touch();
+    void Resize(unsigned int size);
+    bool Merge(unsigned int row, const PropertyColumn& src);
+    bool ConvertTo(PropertyTree::PropertyType t);
+    void ToValues();
+};
+
+/**
+ * Column wise storage of a sequence of maps that all have the same
+ * keys, used by RECORDS nodes. The columns are sorted by key.
+ *
+ * Record nodes are only created when a record is asked for. Their
+ * children read their values from the columns and write changes
+ * back, so the columns are always current.
+ *
+ * @class PropertyRecordTable PropertyRecordTable.h ons/PropertyTree/Utils/PropertyRecordTable.h
+ */
+class PropertyRecordTable {
+public:
+    // shorter sequences gain nothing from columns
+    static const unsigned int MIN_RECORDS = 8;
+private:
+    unsigned int size;
+    vector<PropertyColumn> columns;
+public:
+    // record nodes created so far, NULL for the others
+    vector<PropertyTreeNode*> rows;
+
+    PropertyRecordTable(unsigned int size) : size(size), rows(size, NULL) {}
+
+    unsigned int GetSize() const { return size; }
+    unsigned int GetColumnCount() const { return columns.size(); }
+    PropertyColumn& GetColumn(unsigned int c) { return columns[c]; }
+    const PropertyColumn& GetColumn(unsigned int c) const { return columns[c]; }
+
+    // Columns must be added in key order
+    void AddColumn(const PropertyColumn& c) {
+        columns.push_back(c);
+        columns.back().Resize(size);
+        columns.back().Touch();
+    }
+    int FindColumn(const PropertyAtom* key) const;
+    bool SameSchema(const PropertyRecordTable& other) const;
+    void Resize(unsigned int size);
+
+    // Copy a cell into the child of a record node, returns true if
+    // the node changed
+    bool LoadCell(unsigned int row, unsigned int c, PropertyTreeNode* cell) const;
+    // Returns false if the cell node no longer fits the column
+    bool StoreCell(unsigned int row, unsigned int c, const PropertyTreeNode* cell);
+};
+
+} // NS Utils
+} // NS OpenEngine
+
+#endif // _OE_PROPERTY_RECORD_TABLE_H_
@@ -0,0 +1,302 @@
+//
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "PropertySnapshot.h"
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace Math;
+using namespace std;
+
+template <>
+bool ConvertFromSnapshotNode<Vector<3,float> >(const PropertySnapshotNode* n,
+                                               Vector<3,float>* def) {
+    if (!n->IsArray())
+        return false;
+    Vector<3,float> v = *def;
+    v[0] = n->GetIdx(0,v[0]);
+    v[1] = n->GetIdx(1,v[1]);
+    v[2] = n->GetIdx(2,v[2]);
+    *def = v;
+    return true;
+}
+
+template <>
+bool ConvertFromSnapshotNode<Vector<4,float> >(const PropertySnapshotNode* n,
+                                               Vector<4,float>* def) {
+    if (!n->IsArray())
+        return false;
+    Vector<4,float> v = *def;
+    v[0] = n->GetIdx(0,v[0]);
+    v[1] = n->GetIdx(1,v[1]);
+    v[2] = n->GetIdx(2,v[2]);
+    v[3] = n->GetIdx(3,v[3]);
+    *def = v;
+    return true;
+}
+
+template <>
+bool ConvertFromSnapshotNode<RGBAColor >(const PropertySnapshotNode* n,
+                                         RGBAColor* def) {
+    if (!n->IsArray())
+        return false;
+    RGBAColor v = *def;
+    v[0] = n->GetIdx(0,v[0]);
+    v[1] = n->GetIdx(1,v[1]);
+    v[2] = n->GetIdx(2,v[2]);
+    v[3] = n->GetIdx(3,v[3]);
+    *def = v;
+    return true;
+}
+
+PropertySnapshotNode::PropertySnapshotNode(PropertyTreeNode* n)
+    : kind(n->kind)
+    , value(n->value) {
+    if (n->packed)
+        packed = *n->packed;
+}
+
+PropertySnapshotNode::~PropertySnapshotNode() {
+    if (kind != PropertyTreeNode::RECORDS)
+        return;
+    // the records of a table are built from it and owned by it
+    for (unsigned int i = 0; i < records.size(); i++) {
+        const PropertySnapshotNode* r = records[i].Get();
+        if (!r)
+            continue;
+        for (unsigned int c = 0; c < r->subNodes.size(); c++)
+            delete r->subNodes[c].second;
+        delete r;
+    }
+    for (unsigned int c = 0; c < columns.size(); c++) {
+        if (--columns[c]->refs == 0)
+            delete columns[c];
+    }
+}
+
+/**
+ * Builds record i from the columns. Readers that race for the same
+ * record all build it, the first one to publish it wins.
+ */
+const PropertySnapshotNode* PropertySnapshotNode::GetRecord(unsigned int i) const {
+    const PropertySnapshotNode* r = records[i].Get();
+    if (r)
+        return r;
+    PropertySnapshotNode* record = new PropertySnapshotNode(PropertyTreeNode::MAP);
+    record->subNodes.reserve(columns.size());
+    for (unsigned int c = 0; c < columns.size(); c++) {
+        const PropertyColumn& col = columns[c]->column;
+        PropertySnapshotNode* cell;
+        if (col.kind == PropertyColumn::TUPLE) {
+            cell = new PropertySnapshotNode(PropertyTreeNode::PACKED);
+            col.GetTuple(i, cell->packed);
+        } else {
+            cell = new PropertySnapshotNode(PropertyTreeNode::SCALAR);
+            cell->value = col.GetValue(i);
+        }
+        record->subNodes.push_back(make_pair(col.key, (const PropertySnapshotNode*)cell));
+    }
+    if (records[i].CompareAndSwap(NULL, record))
+        return record;
+    for (unsigned int c = 0; c < record->subNodes.size(); c++)
+        delete record->subNodes[c].second;
+    delete record;
+    return records[i].Get();
+}
+
+const PropertySnapshotNode* PropertySnapshotNode::GetNode(const char* key,
+                                                          unsigned int len) const {
+    // subNodes is sorted by key, see PropertySnapshots::Build
+    unsigned int lo = 0, hi = subNodes.size();
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+        int c = subNodes[mid].first->str.compare(0, string::npos, key, len);
+        if (c == 0)
+            return subNodes[mid].second;
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+const PropertySnapshotNode* PropertySnapshotNode::GetNodePath(const string& keyPath) const {
+    const PropertySnapshotNode* node = this;
+    string::size_type start = 0;
+    while (node) {
+        string::size_type end = keyPath.find('.', start);
+        if (end == string::npos)
+            return node->GetNode(keyPath.data() + start, keyPath.size() - start);
+        node = node->GetNode(keyPath.data() + start, end - start);
+        start = end + 1;
+    }
+    return NULL;
+}
+
+
+PropertySnapshots::PropertySnapshots()
+    : epoch(1) {
+}
+
+PropertySnapshots::~PropertySnapshots() {
+    for (vector<pair<int, const PropertySnapshotNode*> >::iterator itr = retired.begin();
+         itr != retired.end();
+         itr++) {
+        delete itr->second;
+    }
+}
+
+unsigned int PropertySnapshots::Enter() {
+    return Enter(epoch.Get());
+}
+
+unsigned int PropertySnapshots::Enter(int e) {
+    // readers are expected to be few and short lived, so spin until
+    // a slot frees up.
+    for (;;) {
+        for (unsigned int i = 0; i < MAX_READERS; i++) {
+            if (slots[i].CompareAndSwap(0, e))
+                return i;
+        }
+    }
+}
+
+void PropertySnapshots::Leave(unsigned int slot) {
+    slots[slot].Set(0);
+}
+
+int PropertySnapshots::GetEpoch(unsigned int slot) const {
+    return slots[slot].Get();
+}
+
+/**
+ * Rebuild the stale part of the snapshot tree. Nodes whose snapshot
+ * is still valid are shared with the previous version, replaced ones
+ * are retired.
+ */
+const PropertySnapshotNode* PropertySnapshots::Build(PropertyTreeNode* n) {
+    if (n->snapshot && !n->snapshotStale)
+        return n->snapshot;
+
+    PropertySnapshotNode* s = new PropertySnapshotNode(n);
+    if (n->kind == PropertyTreeNode::MAP) {
+        vector<PropertyNodeMap::Entry*> sorted;
+        n->subNodes.GetSorted(sorted);
+        s->subNodes.reserve(sorted.size());
+        for (vector<PropertyNodeMap::Entry*>::iterator itr = sorted.begin();
+             itr != sorted.end();
+             itr++) {
+            s->subNodes.push_back(make_pair((*itr)->first, Build((*itr)->second)));
+        }
+    } else if (n->kind == PropertyTreeNode::ARRAY) {
+        s->subNodesArray.reserve(n->subNodesArray.size());
+        for (vector<PropertyTreeNode*>::iterator itr = n->subNodesArray.begin();
+             itr != n->subNodesArray.end();
+             itr++) {
+            s->subNodesArray.push_back(Build(*itr));
+        }
+    } else if (n->kind == PropertyTreeNode::RECORDS) {
+        // only the columns that changed since the last snapshot are
+        // copied, records are built when they are read
+        const PropertyRecordTable& table = *n->records;
+        const PropertySnapshotNode* last = n->snapshot;
+        s->columns.reserve(table.GetColumnCount());
+        for (unsigned int c = 0; c < table.GetColumnCount(); c++) {
+            const PropertyColumn& col = table.GetColumn(c);
+            PropertySnapshotNode::SharedColumn* shared = NULL;
+            for (unsigned int l = 0; last && !shared && l < last->columns.size(); l++) {
+                if (last->columns[l]->column.version == col.version)
+                    shared = last->columns[l];
+            }
+            if (!shared)
+                shared = new PropertySnapshotNode::SharedColumn(col);
+            shared->refs++;
+            s->columns.push_back(shared);
+        }
+        s->records.resize(table.GetSize());
+        for (unsigned int i = 0; i < table.GetSize(); i++) {
+            if (PropertyTreeNode* record = table.rows[i]) {
+                record->snapshotStale = false;
+                for (PropertyNodeMap::iterator itr = record->subNodes.begin();
+                     itr != record->subNodes.end();
+                     itr++)
+                    itr->second->snapshotStale = false;
+            }
+        }
+    }
+
+    if (n->snapshot)
+        Retire(n->snapshot);
+    n->snapshot = s;
+    n->snapshotStale = false;
+    return s;
+}
+
+void PropertySnapshots::Publish(PropertyTreeNode* root) {
+    const PropertySnapshotNode* r = Build(root);
+    if (r == current.Get())
+        return;
+    current.Set(r);
+    epoch.Increment();
+    Reclaim();
+}
+
+void PropertySnapshots::Retire(const PropertySnapshotNode* n) {
+    retired.push_back(make_pair(epoch.Get(), n));
+}
+
+void PropertySnapshots::Reclaim() {
+    int oldest = epoch.Get();
+    for (unsigned int i = 0; i < MAX_READERS; i++) {
+        int e = slots[i].Get();
+        if (e && e < oldest)
+            oldest = e;
+    }
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < retired.size(); i++) {
+        if (retired[i].first < oldest)
+            delete retired[i].second;
+        else
+            retired[kept++] = retired[i];
+    }
+    retired.resize(kept);
+}
+
+
+PropertySnapshot::PropertySnapshot(PropertySnapshots* s)
+    : snapshots(s)
+    , slot(s->Enter())
+    , root(s->GetCurrent()) {
+}
+
+PropertySnapshot::PropertySnapshot(const PropertySnapshot& other)
+    : snapshots(other.snapshots)
+    , slot(other.snapshots->Enter(other.snapshots->GetEpoch(other.slot)))
+    , root(other.root) {
+}
+
+PropertySnapshot::~PropertySnapshot() {
+    snapshots->Leave(slot);
+}
+
+PropertySnapshot& PropertySnapshot::operator=(const PropertySnapshot& other) {
+    if (this == &other)
+        return *this;
+    unsigned int newSlot = other.snapshots->Enter(other.snapshots->GetEpoch(other.slot));
+    snapshots->Leave(slot);
+    snapshots = other.snapshots;
+    slot = newSlot;
+    root = other.root;
+    return *this;
+}
+
+} // NS Utils
+} // NS OpenEngine
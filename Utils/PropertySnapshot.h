@@ -0,0 +1,223 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+
+#ifndef _OE_PROPERTY_SNAPSHOT_H_
+#define _OE_PROPERTY_SNAPSHOT_H_
+
+#include "PropertyTreeNode.h"
+#include "Atomic.h"
+#include <string>
+#include <vector>
+
+namespace OpenEngine {
+namespace Utils {
+
+class PropertySnapshotNode;
+
+using namespace std;
+
+    // special
+
+    template <class T>
+    bool ConvertFromSnapshotNode(const PropertySnapshotNode* n, T* def) {
+        return false;
+    }
+
+    template <>
+    bool ConvertFromSnapshotNode<Math::Vector<3,float> >
+    (const PropertySnapshotNode* n, Math::Vector<3,float>* def);
+
+    template <>
+    bool ConvertFromSnapshotNode<Math::Vector<4,float> >
+    (const PropertySnapshotNode* n, Math::Vector<4,float>* def);
+
+    template <>
+    bool ConvertFromSnapshotNode<Math::RGBAColor >
+    (const PropertySnapshotNode* n, Math::RGBAColor* def);
+
+/**
+ * Immutable copy of a property tree node.
+ *
+ * Snapshot nodes are never changed once published, so any number of
+ * threads can read them without locking. Unchanged subtrees are
+ * shared between consecutive snapshots. Lookups never create nodes,
+ * missing keys return NULL or the given default.
+ *
+ * RECORDS nodes keep copies of the columns, shared with the previous
+ * snapshot for columns that did not change. A record node is built
+ * from them the first time a reader asks for it.
+ *
+ * @class PropertySnapshotNode PropertySnapshot.h ons/PropertyTree/Utils/PropertySnapshot.h
+ */
+class PropertySnapshotNode {
+private:
+    friend class PropertySnapshots;
+
+    // only counted and freed on the writer thread, see Reclaim
+    struct SharedColumn {
+        PropertyColumn column;
+        unsigned int refs;
+        SharedColumn(const PropertyColumn& c) : column(c), refs(0) {}
+    };
+
+    PropertyTreeNode::Kind kind;
+    PropertyValue value;
+    vector<pair<const PropertyAtom*, const PropertySnapshotNode*> > subNodes;
+    vector<const PropertySnapshotNode*> subNodesArray;
+    PropertyPackedArray packed;
+    vector<SharedColumn*> columns;
+    mutable vector<AtomicPointer<const PropertySnapshotNode> > records;
+
+    const PropertySnapshotNode* GetNode(const char* key, unsigned int len) const;
+    const PropertySnapshotNode* GetRecord(unsigned int i) const;
+    PropertySnapshotNode(PropertyTreeNode::Kind kind) : kind(kind) {}
+public:
+    PropertySnapshotNode(PropertyTreeNode* n);
+    ~PropertySnapshotNode();
+
+    bool IsArray() const {
+        return (kind == PropertyTreeNode::ARRAY || kind == PropertyTreeNode::PACKED ||
+                kind == PropertyTreeNode::RECORDS);
+    }
+    bool IsPacked() const {
+        return (kind == PropertyTreeNode::PACKED);
+    }
+    bool IsMap() const {
+        return (kind == PropertyTreeNode::MAP);
+    }
+
+    unsigned int GetSize() const {
+        if (kind == PropertyTreeNode::PACKED)
+            return packed.GetSize();
+        if (kind == PropertyTreeNode::RECORDS)
+            return records.size();
+        return subNodesArray.size();
+    }
+
+    // Empty unless the node is packed with elements of type E
+    template <class E>
+    PropertySpan<const E> GetArray() const {
+        PropertySpan<const E> span;
+        packed.Get(span);
+        return span;
+    }
+
+    const PropertySnapshotNode* GetNode(const string& key) const {
+        return GetNode(key.data(), key.size());
+    }
+    const PropertySnapshotNode* GetNodeIdx(unsigned int i) const {
+        if (kind == PropertyTreeNode::RECORDS)
+            return i < records.size() ? GetRecord(i) : NULL;
+        if (i >= subNodesArray.size())
+            return NULL;
+        return subNodesArray[i];
+    }
+    const PropertySnapshotNode* GetNodePath(const string& keyPath) const;
+
+    template <class T>
+    T Get(T def) const {
+        T val = def;
+        if (!ConvertFromSnapshotNode<T>(this, &val))
+            PropertyValueTraits<T>::Load(value, &val);
+        return val;
+    }
+
+    template <class T>
+    T GetIdx(unsigned int i, T def) const {
+        if (kind == PropertyTreeNode::PACKED) {
+            if (i < packed.GetSize())
+                PropertyValueTraits<T>::Load(packed.GetElement(i), &def);
+            return def;
+        }
+        const PropertySnapshotNode* node = GetNodeIdx(i);
+        return node ? node->Get(def) : def;
+    }
+
+    template <class T>
+    T GetPath(const string& keyPath, T def) const {
+        const PropertySnapshotNode* node = GetNodePath(keyPath);
+        return node ? node->Get(def) : def;
+    }
+};
+
+/**
+ * Epoch based publication and reclamation of snapshot nodes.
+ *
+ * The writer thread publishes a new snapshot root and retires the
+ * nodes it replaced, tagged with the current epoch, before advancing
+ * the epoch. Readers announce the epoch they entered in a slot before
+ * loading the root. Retired nodes are freed once every active reader
+ * entered after they were retired.
+ *
+ * All methods except Enter and Leave must be called from the thread
+ * that changes the tree.
+ *
+ * @class PropertySnapshots PropertySnapshot.h ons/PropertyTree/Utils/PropertySnapshot.h
+ */
+class PropertySnapshots {
+public:
+    static const unsigned int MAX_READERS = 64;
+private:
+    AtomicPointer<const PropertySnapshotNode> current;
+    AtomicInt epoch;
+    AtomicInt slots[MAX_READERS];
+    vector<pair<int, const PropertySnapshotNode*> > retired;
+
+    const PropertySnapshotNode* Build(PropertyTreeNode* n);
+public:
+    PropertySnapshots();
+    ~PropertySnapshots();
+
+    unsigned int Enter();
+    unsigned int Enter(int e);
+    void Leave(unsigned int slot);
+    int GetEpoch(unsigned int slot) const;
+
+    const PropertySnapshotNode* GetCurrent() const {
+        return current.Get();
+    }
+
+    void Publish(PropertyTreeNode* root);
+    void Retire(const PropertySnapshotNode* n);
+    void Reclaim();
+};
+
+/**
+ * Read only view of a property tree at one point in time.
+ *
+ * Obtained from PropertyTree::Snapshot, the view can be used from
+ * any thread without locks. The nodes it references stay alive until
+ * the view is destroyed, even if the tree has changed or published
+ * newer snapshots in the mean time. Keep views short lived, the
+ * number of concurrently held views is limited to MAX_READERS.
+ *
+ * @class PropertySnapshot PropertySnapshot.h ons/PropertyTree/Utils/PropertySnapshot.h
+ */
+class PropertySnapshot {
+private:
+    PropertySnapshots* snapshots;
+    unsigned int slot;
+    const PropertySnapshotNode* root;
+public:
+    PropertySnapshot(PropertySnapshots* s);
+    PropertySnapshot(const PropertySnapshot& other);
+    ~PropertySnapshot();
+
+    PropertySnapshot& operator=(const PropertySnapshot& other);
+
+    const PropertySnapshotNode* GetRootNode() const {
+        return root;
+    }
+};
+
+} // NS Utils
+} // NS OpenEngine
+
+#endif // _OE_PROPERTY_SNAPSHOT_H_
@@ -0,0 +1,134 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+
+#ifndef _OE_PROPERTY_STRUCT_BINDER_H_
+#define _OE_PROPERTY_STRUCT_BINDER_H_
+
+#include <Core/IListener.h>
+#include <Core/Event.h>
+#include <Utils/PropertyTreeNode.h>
+#include <vector>
+
+namespace OpenEngine {
+namespace Utils {
+
+/**
+ * Loads the member M of type T of S from a node. The member is fixed
+ * at compile time, so every field has a function of its own and no
+ * member pointer is stored or converted.
+ */
+template <class S, class T, T S::* M>
+void LoadPropertyField(PropertyTreeNode* n, S& s) {
+    s.*M = n->Get<T>(s.*M);
+}
+
+/**
+ * Binds a key of a subtree to a data member of S through its
+ * LoadPropertyField function. Field tables are plain aggregates and
+ * are initialized at compile time.
+ */
+template <class S>
+struct PropertyField {
+    const char* key;
+    void (*load)(PropertyTreeNode* n, S& s);
+};
+
+/**
+ * Keeps the fields of a struct in sync with the children of a node.
+ *
+ * One listener is attached to the subtree. On a change the binder
+ * walks its field list once, looks the children up by atom and only
+ * converts those whose version moved. The current field values are
+ * the defaults for missing keys. StructChangedEvent fires after any
+ * field was updated. The node is held like by PropertyBinder.
+ *
+ * @code
+ * struct LightConfig { float intensity; int samples; };
+ * static const PropertyField<LightConfig> lightFields[] = {
+ *     {"intensity", &LoadPropertyField<LightConfig, float, &LightConfig::intensity>},
+ *     {"samples", &LoadPropertyField<LightConfig, int, &LightConfig::samples>}
+ * };
+ * PropertyStructBinder<LightConfig> binder(node, config, lightFields);
+ * @endcode
+ *
+ * @class PropertyStructBinder PropertyStructBinder.h ons/PropertyTree/Utils/PropertyStructBinder.h
+ */
+template <class S>
+class PropertyStructBinder : public Core::IListener<PropertiesChangedEventArg> {
+private:
+    PropertyTreeNode* node;
+    S& instance;
+    const PropertyField<S>* fields;
+    unsigned int count;
+    vector<const PropertyAtom*> keys;
+    vector<unsigned int> versions;
+    Core::Event<PropertiesChangedEventArg> changedEvent;
+
+    PropertyStructBinder(const PropertyStructBinder&);
+    PropertyStructBinder& operator=(const PropertyStructBinder&);
+
+    void Init() {
+        node->Retain();
+        keys.resize(count);
+        versions.resize(count);
+        for (unsigned int i = 0; i < count; i++) {
+            keys[i] = node->GetTree()->GetAtomTable().Intern(fields[i].key);
+            PropertyTreeNode* n = node->GetNode(keys[i]);
+            fields[i].load(n, instance);
+            versions[i] = n->GetSubtreeVersion();
+        }
+        node->PropertiesChangedEvent().Attach(*this);
+    }
+public:
+    template <unsigned int N>
+    PropertyStructBinder(PropertyTreeNode* n, S& inst,
+                         const PropertyField<S> (&f)[N])
+        : node(n), instance(inst), fields(f), count(N) {
+        Init();
+    }
+
+    PropertyStructBinder(PropertyTreeNode* n, S& inst,
+                         const PropertyField<S>* f, unsigned int count)
+        : node(n), instance(inst), fields(f), count(count) {
+        Init();
+    }
+
+    ~PropertyStructBinder() {
+        node->PropertiesChangedEvent().Detach(*this);
+        node->Release();
+    }
+
+    void Handle(PropertiesChangedEventArg arg) {
+        if (!arg.IsValueChange() && !arg.IsStructureChange())
+            return;
+        if (node->IsRemoved())
+            return;
+        bool changed = false;
+        for (unsigned int i = 0; i < count; i++) {
+            PropertyTreeNode* n = node->subNodes.Find(keys[i]);
+            if (!n || n->GetSubtreeVersion() == versions[i])
+                continue;
+            fields[i].load(n, instance);
+            versions[i] = n->GetSubtreeVersion();
+            changed = true;
+        }
+        if (changed)
+            changedEvent.Notify(arg);
+    }
+
+    Core::IEvent<PropertiesChangedEventArg>& StructChangedEvent() {
+        return changedEvent;
+    }
+};
+
+} // NS Utils
+} // NS OpenEngine
+
+#endif // _OE_PROPERTY_STRUCT_BINDER_H_
@@ -0,0 +1,127 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "PropertySubscriptions.h"
+#include <algorithm>
+
+namespace OpenEngine {
+namespace Utils {
+
+PropertySubscriptions::Node::~Node() {
+    for (map<const PropertyAtom*, Node*>::iterator itr = children.begin();
+         itr != children.end();
+         itr++)
+        delete itr->second;
+    delete any;
+}
+
+PropertySubscriptions::PropertySubscriptions(PropertyAtomTable& atoms)
+    : atoms(atoms), count(0) {
+}
+
+/**
+ * Walks the trie along the pattern. A trailing "**" is not a trie
+ * level of its own, it is reported through below instead.
+ */
+PropertySubscriptions::Node* PropertySubscriptions::FindNode(const string& pattern,
+                                                             bool create,
+                                                             bool& below) {
+    Node* node = &root;
+    below = false;
+    if (pattern.empty())
+        return node;
+    string::size_type start = 0;
+    while (node && start <= pattern.size()) {
+        string::size_type end = pattern.find('.', start);
+        if (end == string::npos)
+            end = pattern.size();
+        string::size_type len = end - start;
+        if (len == 2 && pattern.compare(start, 2, "**") == 0 && end == pattern.size()) {
+            below = true;
+            break;
+        }
+        if (len == 1 && pattern[start] == '*') {
+            if (!node->any && create)
+                node->any = new Node();
+            node = node->any;
+        } else {
+            const PropertyAtom* key = create
+                ? atoms.Intern(pattern.data() + start, len)
+                : atoms.Find(pattern.data() + start, len);
+            map<const PropertyAtom*, Node*>::iterator itr = node->children.find(key);
+            if (itr != node->children.end())
+                node = itr->second;
+            else if (create)
+                node = node->children[key] = new Node();
+            else
+                node = NULL;
+        }
+        start = end + 1;
+    }
+    return node;
+}
+
+void PropertySubscriptions::Subscribe(const string& pattern, Listener& l) {
+    bool below;
+    Node* node = FindNode(pattern, true, below);
+    (below ? node->below : node->exact).push_back(&l);
+    count++;
+}
+
+void PropertySubscriptions::Remove(vector<Listener*>& ls, Listener* l) {
+    vector<Listener*>::iterator itr = find(ls.begin(), ls.end(), l);
+    if (itr != ls.end())
+        ls.erase(itr);
+}
+
+void PropertySubscriptions::Unsubscribe(const string& pattern, Listener& l) {
+    bool below;
+    Node* node = FindNode(pattern, false, below);
+    if (!node)
+        return;
+    vector<Listener*>& ls = below ? node->below : node->exact;
+    unsigned int size = ls.size();
+    Remove(ls, &l);
+    count -= size - ls.size();
+}
+
+/**
+ * Collects the listeners whose pattern matches the path, given as the
+ * keys from the root down. A listener is reported once per matching
+ * pattern. Listeners of "**" patterns are left out unless below is
+ * set.
+ */
+void PropertySubscriptions::Match(const vector<const PropertyAtom*>& path,
+                                  vector<Listener*>& out, bool below) {
+    states.clear();
+    states.push_back(&root);
+    for (unsigned int i = 0; i < path.size() && !states.empty(); i++) {
+        next.clear();
+        for (vector<const Node*>::iterator itr = states.begin();
+             itr != states.end();
+             itr++) {
+            const Node* s = *itr;
+            if (below)
+                out.insert(out.end(), s->below.begin(), s->below.end());
+            map<const PropertyAtom*, Node*>::const_iterator c = s->children.find(path[i]);
+            if (c != s->children.end())
+                next.push_back(c->second);
+            if (s->any)
+                next.push_back(s->any);
+        }
+        states.swap(next);
+    }
+    for (vector<const Node*>::iterator itr = states.begin();
+         itr != states.end();
+         itr++)
+        out.insert(out.end(), (*itr)->exact.begin(), (*itr)->exact.end());
+}
+
+} // NS Utils
+} // NS OpenEngine
@@ -0,0 +1,78 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+
+#ifndef _OE_PROPERTY_SUBSCRIPTIONS_H_
+#define _OE_PROPERTY_SUBSCRIPTIONS_H_
+
+#include "PropertyAtomTable.h"
+#include <map>
+#include <vector>
+#include <string>
+#include <Core/IListener.h>
+
+namespace OpenEngine {
+namespace Utils {
+
+class PropertiesChangedEventArg;
+
+using namespace std;
+
+/**
+ * Listeners registered by path pattern, kept in a trie keyed by atom.
+ *
+ * A pattern is a dotted path where a segment may be "*", matching any
+ * single key, and the last segment may be "**", matching every node
+ * below the path before it. "render.shadows" matches that node only,
+ * "lights.*.color" the color of every light and "render.**" everything
+ * below render. A "**" pattern is only told about nodes that changed
+ * themselves, not about their ancestors, so one change reaches it
+ * once.
+ *
+ * Subscribing never creates tree nodes, a pattern simply starts
+ * matching when a node with that path appears.
+ *
+ * @class PropertySubscriptions PropertySubscriptions.h ons/PropertyTree/Utils/PropertySubscriptions.h
+ */
+class PropertySubscriptions {
+public:
+    typedef Core::IListener<PropertiesChangedEventArg> Listener;
+private:
+    struct Node {
+        map<const PropertyAtom*, Node*> children;
+        Node* any;
+        vector<Listener*> exact;
+        vector<Listener*> below;
+        Node() : any(NULL) {}
+        ~Node();
+    };
+
+    PropertyAtomTable& atoms;
+    Node root;
+    unsigned int count;
+    vector<const Node*> states;
+    vector<const Node*> next;
+
+    Node* FindNode(const string& pattern, bool create, bool& below);
+    static void Remove(vector<Listener*>& ls, Listener* l);
+public:
+    PropertySubscriptions(PropertyAtomTable& atoms);
+
+    void Subscribe(const string& pattern, Listener& l);
+    void Unsubscribe(const string& pattern, Listener& l);
+    bool IsEmpty() const { return count == 0; }
+
+    void Match(const vector<const PropertyAtom*>& path, vector<Listener*>& out,
+               bool below=true);
+};
+
+} // NS Utils
+} // NS OpenEngine
+
+#endif // _OE_PROPERTY_SUBSCRIPTIONS_H_
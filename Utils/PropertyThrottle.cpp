@@ -0,0 +1,48 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "PropertyThrottle.h"
+
+namespace OpenEngine {
+namespace Utils {
+
+PropertyThrottle::PropertyThrottle(PropertyTree* t, PropertyTreeNode* n,
+                                   Core::IListener<PropertiesChangedEventArg>* l,
+                                   unsigned int interval, unsigned int frames)
+    : tree(t), node(n), listener(l)
+    , interval(interval), frames(frames)
+    , lastTime(0), lastFrame(0)
+    , flags(0), queued(false), delivered(false) {
+}
+
+void PropertyThrottle::Handle(PropertiesChangedEventArg arg) {
+    flags |= arg.GetFlags();
+    if (!queued) {
+        queued = true;
+        tree->QueueThrottle(this);
+    }
+}
+
+bool PropertyThrottle::IsReady(unsigned int frame, unsigned long long now) {
+    if (!delivered)
+        return true;
+    return frame - lastFrame >= frames && now - lastTime >= interval;
+}
+
+void PropertyThrottle::Deliver(unsigned int frame, unsigned long long now) {
+    PropertiesChangedEventArg arg(node, PropertiesChangedEventArg::ChangeFlag(flags));
+    flags = 0;
+    lastFrame = frame;
+    lastTime = now;
+    delivered = true;
+    listener->Handle(arg);
+}
+
+} // NS Utils
+} // NS OpenEngine
@@ -0,0 +1,61 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+
+#ifndef _OE_PROPERTY_THROTTLE_H_
+#define _OE_PROPERTY_THROTTLE_H_
+
+#include "PropertyTree.h"
+#include <Core/IListener.h>
+
+namespace OpenEngine {
+namespace Utils {
+
+/**
+ * Rate limited delivery of the changes of one node to a listener.
+ *
+ * The throttle is attached to the changed event of the node and
+ * collects the flags of every change. The tree hands the merged change
+ * to the listener from Handle once both the minimum interval and the
+ * minimum number of frames have passed since the last delivery. A
+ * change after a quiet period is delivered on the next frame.
+ *
+ * Throttles are created and owned by the tree, see
+ * PropertyTreeNode::AttachThrottled.
+ *
+ * @class PropertyThrottle PropertyThrottle.h ons/PropertyTree/Utils/PropertyThrottle.h
+ */
+class PropertyThrottle : public Core::IListener<PropertiesChangedEventArg> {
+    friend class PropertyTree;
+private:
+    PropertyTree* tree;
+    PropertyTreeNode* node;
+    Core::IListener<PropertiesChangedEventArg>* listener;
+    unsigned int interval;
+    unsigned int frames;
+    unsigned long long lastTime;
+    unsigned int lastFrame;
+    unsigned int flags;
+    bool queued;
+    bool delivered;
+
+    bool IsReady(unsigned int frame, unsigned long long now);
+    void Deliver(unsigned int frame, unsigned long long now);
+public:
+    PropertyThrottle(PropertyTree* t, PropertyTreeNode* n,
+                     Core::IListener<PropertiesChangedEventArg>* l,
+                     unsigned int interval, unsigned int frames);
+
+    void Handle(PropertiesChangedEventArg arg);
+};
+
+} // NS Utils
+} // NS OpenEngine
+
+#endif // _OE_PROPERTY_THROTTLE_H_
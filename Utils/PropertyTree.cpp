@@ -9,25 +9,166 @@
 
 #include "PropertyTree.h"
 #include "PropertyTreeNode.h"
+#include "PropertySnapshot.h"
+#include "FileWatcher.h"
+#include "PropertyThrottle.h"
+#include "PropertyPackedArray.h"
+#include "PropertyRecordTable.h"
+#include "PropertyIndex.h"
+#include "Atomic.h"
 
+#include <cstdlib>
 #include <fstream>
+#include <algorithm>
 #include <boost/algorithm/string.hpp>
+#include <Core/Thread.h>
 #include <Logging/Logger.h>
 #include <Resources/File.h>
 #include <Utils/Convert.h>
+#include <Utils/Timer.h>
 
 namespace OpenEngine {
 namespace Utils {
 
 using namespace std;
 
-PropertyTree::PropertyTree() {
-    root = new PropertyTreeNode(this, NULL,  "");
+/**
+ * Parses a property file and builds a scratch tree from it on a
+ * worker thread. The result is merged into the live tree by
+ * PropertyTree::Handle once the thread is done.
+ */
+class PropertyTreeLoader : public Core::Thread {
+public:
+    string filename;
+    YAML::Node* doc;
+    PropertyTree& shadow;
+    unsigned int serial;
+    bool ok;
+    string error;
+    AtomicInt done;
+
+    PropertyTreeLoader(string file, PropertyTree& shadow, unsigned int serial)
+        : filename(file), doc(new YAML::Node()), shadow(shadow)
+        , serial(serial), ok(false), done(0) {}
+    ~PropertyTreeLoader() {
+        delete doc;
+    }
+
+    void Run() {
+        try {
+            ok = PropertyTree::ParseFile(filename, *doc, shadow);
+            if (!ok)
+                error = "no document";
+        } catch (YAML::Exception& e) {
+            error = e.what();
+        }
+        done.Set(1);
+    }
+};
+
+PropertyTree::PropertyTree()
+    : pool(sizeof(PropertyTreeNode)), subscriptions(atoms)
+    , doc(new YAML::Node()), generation(0), dirtyCount(0), transactionDepth(0)
+    , dispatchPos(0), queuedEvents(0), budgetTime(0), budgetCount(0), frame(0)
+    , dispatching(false), destroying(false)
+    , versionClock(1), versionObserved(false)
+    , saveTypeHints(false)
+    , watcher(NULL), loader(NULL), reloadRequested(false)
+    , snapshots(new PropertySnapshots()), scratch(NULL), loaderScratch(NULL)
+    , loadSerial(0), appliedSerial(0) {
+    root = CreateNode(NULL, NULL);
 }
 
-PropertyTree::PropertyTree(string fname) : filename(fname) {
-    root = new PropertyTreeNode(this, NULL, "");
+PropertyTree::PropertyTree(string fname)
+    : pool(sizeof(PropertyTreeNode)), subscriptions(atoms)
+    , doc(new YAML::Node()), generation(0), dirtyCount(0), transactionDepth(0)
+    , dispatchPos(0), queuedEvents(0), budgetTime(0), budgetCount(0), frame(0)
+    , dispatching(false), destroying(false)
+    , versionClock(1), versionObserved(false)
+    , saveTypeHints(false)
+    , filename(fname)
+    , watcher(NULL), loader(NULL), reloadRequested(false)
+    , snapshots(new PropertySnapshots()), scratch(NULL), loaderScratch(NULL)
+    , loadSerial(0), appliedSerial(0) {
+    root = CreateNode(NULL, NULL);
     Reload(true);
+    watcher = new FileWatcher(filename);
+    watcher->Start();
+}
+
+/**
+ * Every node goes at once, so nodes do not take themselves out of the
+ * dirty set, the indexes and the throttles, and their memory is left
+ * to the pool.
+ */
+PropertyTree::~PropertyTree() {
+    delete watcher;
+    if (loader) {
+        loader->Wait();
+        delete loader;
+    }
+    delete scratch;
+    delete loaderScratch;
+    destroying = true;
+    DestroyNode(root);
+    for (unsigned int i = 0; i < removedNodes.size(); i++)
+        DestroyNode(removedNodes[i]);
+    // removed throttles are only left in the queue
+    for (vector<PropertyThrottle*>::iterator itr = queuedThrottles.begin();
+         itr != queuedThrottles.end();
+         itr++)
+        if (!(*itr)->listener)
+            delete *itr;
+    for (vector<PropertyThrottle*>::iterator itr = throttles.begin();
+         itr != throttles.end();
+         itr++)
+        delete *itr;
+    for (vector<PropertyIndex*>::iterator itr = indexes.begin();
+         itr != indexes.end();
+         itr++)
+        delete *itr;
+    delete doc;
+    delete snapshots;
+}
+
+PropertyTreeNode* PropertyTree::CreateNode(PropertyTreeNode* parent, const PropertyAtom* key) {
+    return new (pool.Allocate()) PropertyTreeNode(this, parent, key);
+}
+
+void PropertyTree::DestroyNode(PropertyTreeNode* n) {
+    n->~PropertyTreeNode();
+    if (!destroying)
+        pool.Free(n);
+}
+
+/**
+ * Takes a node out of the tree. A subtree that is still held or
+ * listened to is detached and marked removed instead of freed, so
+ * pointers to it stay valid. See PropertyTreeNode::Retain.
+ */
+void PropertyTree::RemoveNode(PropertyTreeNode* n) {
+    if (destroying || !n->IsSubtreeHeld()) {
+        DestroyNode(n);
+        return;
+    }
+    n->parent = NULL;
+    n->MarkRemoved();
+    removedNodes.push_back(n);
+}
+
+/**
+ * Frees the removed subtrees that nothing holds any more.
+ */
+void PropertyTree::SweepRemovedNodes() {
+    unsigned int keep = 0;
+    for (unsigned int i = 0; i < removedNodes.size(); i++) {
+        PropertyTreeNode* n = removedNodes[i];
+        if (n->IsSubtreeHeld())
+            removedNodes[keep++] = n;
+        else
+            DestroyNode(n);
+    }
+    removedNodes.resize(keep);
 }
 
 PropertyTreeNode* PropertyTree::GetRootNode() {
@@ -35,9 +176,339 @@ PropertyTreeNode* PropertyTree::GetRootNode() {
 }
 
 
-void PropertyTree::AddToDirtySet(PropertyTreeNode* n,
-                                 PropertiesChangedEventArg::ChangeFlag f) {
-    dirtySet.insert(make_pair<>(n,f));
+/**
+ * Queues a node for dispatch. The flags themselves live on the node,
+ * so a node is queued at most once no matter how often it is set.
+ */
+void PropertyTree::AddToDirtySet(PropertyTreeNode* n) {
+    n->dirtyIndex = dirtyNodes.size();
+    dirtyNodes.push_back(n);
+    queuedEvents++;
+}
+
+void PropertyTree::RemoveFromDirtySet(PropertyTreeNode* n) {
+    if (n->dirtyIndex >= 0) {
+        dirtyNodes[n->dirtyIndex] = NULL;
+        queuedEvents--;
+    }
+    if (n->dispatchIndex >= 0) {
+        // notified nodes stay in the list until the pass is done
+        if ((unsigned int)n->dispatchIndex >= dispatchPos)
+            queuedEvents--;
+        dispatchList[n->dispatchIndex].node = NULL;
+    }
+    n->dirtyIndex = n->dispatchIndex = -1;
+    n->dirtyFlags = n->pendingFlags = 0;
+    n->firstDirtyChild = n->nextDirtySibling = NULL;
+}
+
+/**
+ * Moves the queued nodes to the dispatch list in post order. Children
+ * come before their parents and every subtree ends up as one
+ * contiguous span ending with its root.
+ */
+void PropertyTree::OrderDirtyNodes() {
+    // link each queued node below its nearest queued ancestor
+    dirtyRoots.clear();
+    for (unsigned int i = dirtyNodes.size(); i > 0; i--) {
+        PropertyTreeNode* n = dirtyNodes[i-1];
+        if (!n) continue;
+        PropertyTreeNode* p = n->parent;
+        while (p && p->dirtyIndex < 0)
+            p = p->parent;
+        if (p) {
+            n->nextDirtySibling = p->firstDirtyChild;
+            p->firstDirtyChild = n;
+        } else
+            dirtyRoots.push_back(n);
+    }
+
+    dispatchList.clear();
+    spanBegins.clear();
+    for (unsigned int i = dirtyRoots.size(); i > 0; i--) {
+        dispatchStack.push_back(make_pair(dirtyRoots[i-1],
+                                        (unsigned int)dispatchList.size()));
+        while (!dispatchStack.empty()) {
+            PropertyTreeNode* n = dispatchStack.back().first;
+            PropertyTreeNode* c = n->firstDirtyChild;
+            if (c) {
+                n->firstDirtyChild = c->nextDirtySibling;
+                c->nextDirtySibling = NULL;
+                dispatchStack.push_back(make_pair(c, (unsigned int)dispatchList.size()));
+                continue;
+            }
+            n->dirtyIndex = -1;
+            n->dispatchIndex = dispatchList.size();
+            dispatchList.push_back(PropertiesChangedEventArg(n));
+            spanBegins.push_back(dispatchStack.back().second);
+            dispatchStack.pop_back();
+        }
+    }
+    dirtyNodes.clear();
+}
+
+/**
+ * Notifies every dirty node once with its merged flags, followed by
+ * the batch of changes in its subtree. Nodes changed by a listener
+ * before their own turn are merged into this pass, later changes are
+ * queued for the next one.
+ *
+ * When limited by the dispatch budget the pass may stop early and is
+ * continued from the same place on the next call. Returns false if
+ * notifications are left.
+ *
+ * A pass is not reentrant. Called from a listener it returns false
+ * right away and the pass in progress goes on.
+ */
+bool PropertyTree::DispatchEvents(bool limited) {
+    if (dispatching)
+        return false;
+    if (dispatchList.empty())
+        OrderDirtyNodes();
+    limited = limited && (budgetTime || budgetCount);
+    unsigned long long start = limited ? Timer::GetTime().AsInt() : 0;
+    unsigned int count = 0;
+    dispatching = true;
+    while (dispatchPos < dispatchList.size()) {
+        if (limited && count &&
+            ((budgetCount && count >= budgetCount) ||
+             (budgetTime && Timer::GetTime().AsInt() - start >= budgetTime))) {
+            dispatching = false;
+            return false;
+        }
+        unsigned int i = dispatchPos++;
+        PropertyTreeNode* n = dispatchList[i].node;
+        if (!n) continue;
+        count++;
+        queuedEvents--;
+        bool changed = n->dirtyFlags & PropertyTreeNode::SELF_CHANGED;
+        dispatchList[i].flags = PropertiesChangedEventArg::ChangeFlag(
+            n->dirtyFlags & ~PropertyTreeNode::SELF_CHANGED);
+        n->dirtyFlags = 0;
+        PropertiesChangedEventArg arg(dispatchList[i]);
+        if (n->extras)
+            n->extras->changedEvent.Notify(arg);
+        if (dispatchList[i].node && n->extras &&
+            n->extras->batchEvent.Size()) {
+            PropertiesChangedBatchEventArg batch(n,
+                                                 &dispatchList[spanBegins[i]],
+                                                 &dispatchList[i] + 1);
+            n->extras->batchEvent.Notify(batch);
+        }
+        // listeners may have detached the last of themselves
+        if (dispatchList[i].node)
+            n->ReleaseExtras();
+        // removed nodes no longer have a path
+        if (dispatchList[i].node && !n->removed && !subscriptions.IsEmpty())
+            NotifySubscribers(arg, changed);
+    }
+    for (vector<PropertiesChangedEventArg>::iterator itr = dispatchList.begin();
+         itr != dispatchList.end();
+         itr++) {
+        if (itr->node)
+            itr->node->dispatchIndex = -1;
+    }
+    dispatchList.clear();
+    dispatchPos = 0;
+    dispatching = false;
+    return true;
+}
+
+/**
+ * Notifies the listeners subscribed to a pattern matching the path of
+ * the node. They are told once per dispatch pass with the merged
+ * flags, just like listeners on the node itself. "**" patterns only
+ * match nodes that changed themselves.
+ */
+void PropertyTree::NotifySubscribers(PropertiesChangedEventArg& arg,
+                                     bool changed) {
+    keyPath.clear();
+    for (PropertyTreeNode* n = arg.GetNode(); n != root; n = n->parent)
+        keyPath.push_back(n->key);
+    reverse(keyPath.begin(), keyPath.end());
+    // listeners may load and match again, that only appends
+    unsigned int begin = subscribers.size();
+    subscriptions.Match(keyPath, subscribers, changed);
+    for (unsigned int i = begin; i < subscribers.size(); i++)
+        subscribers[i]->Handle(arg);
+    subscribers.resize(begin);
+}
+
+void PropertyTree::Subscribe(const string& pattern,
+                             Core::IListener<PropertiesChangedEventArg>& listener) {
+    subscriptions.Subscribe(pattern, listener);
+}
+
+void PropertyTree::Unsubscribe(const string& pattern,
+                               Core::IListener<PropertiesChangedEventArg>& listener) {
+    subscriptions.Unsubscribe(pattern, listener);
+}
+
+PropertyThrottle* PropertyTree::AddThrottle(PropertyTreeNode* n,
+                                            Core::IListener<PropertiesChangedEventArg>& l,
+                                            unsigned int interval,
+                                            unsigned int frames) {
+    PropertyThrottle* t = new PropertyThrottle(this, n, &l, interval, frames);
+    throttles.push_back(t);
+    n->throttled = true;
+    n->PropertiesChangedEvent().Attach(*t);
+    return t;
+}
+
+/**
+ * Detaches a throttle. A throttle in the queue is only marked dead by
+ * clearing its listener and deleted by FlushThrottles.
+ */
+void PropertyTree::RemoveThrottle(PropertyThrottle* t) {
+    t->node->PropertiesChangedEvent().Detach(*t);
+    t->listener = NULL;
+    if (!t->queued)
+        delete t;
+}
+
+/**
+ * Removes the throttles of a node, or only those for the given
+ * listener.
+ */
+void PropertyTree::RemoveThrottles(PropertyTreeNode* n,
+                                   Core::IListener<PropertiesChangedEventArg>* l) {
+    unsigned int keep = 0;
+    bool left = false;
+    for (unsigned int i = 0; i < throttles.size(); i++) {
+        PropertyThrottle* t = throttles[i];
+        if (t->node == n && (!l || t->listener == l)) {
+            RemoveThrottle(t);
+            continue;
+        }
+        if (t->node == n)
+            left = true;
+        throttles[keep++] = t;
+    }
+    throttles.resize(keep);
+    n->throttled = left;
+}
+
+PropertyIndex* PropertyTree::AddIndex(PropertyTreeNode* n, const string& key) {
+    const PropertyAtom* atom = atoms.Intern(key);
+    for (unsigned int i = 0; i < indexes.size(); i++) {
+        if (indexes[i]->node == n && indexes[i]->key == atom)
+            return indexes[i];
+    }
+    PropertyIndex* index = new PropertyIndex(n, atom);
+    indexes.push_back(index);
+    n->indexed = true;
+    return index;
+}
+
+/**
+ * Removes the indexes of a node, or only the one for the given key.
+ */
+void PropertyTree::RemoveIndexes(PropertyTreeNode* n, const PropertyAtom* key) {
+    unsigned int keep = 0;
+    bool left = false;
+    for (unsigned int i = 0; i < indexes.size(); i++) {
+        PropertyIndex* index = indexes[i];
+        if (index->node == n && (!key || index->key == key)) {
+            delete index;
+            continue;
+        }
+        if (index->node == n)
+            left = true;
+        indexes[keep++] = index;
+    }
+    indexes.resize(keep);
+    n->indexed = left;
+}
+
+/**
+ * Keeps the indexes of arrays above n current through a change of
+ * its value to version v, so they are not rebuilt for it. If n is
+ * the key of a record its entry is moved. Indexes that were already
+ * out of date and other changes are left to the version check.
+ */
+void PropertyTree::UpdateIndexes(PropertyTreeNode* n, unsigned int f,
+                                 unsigned int v) {
+    if (f != PropertiesChangedEventArg::VALUE)
+        return;
+    unsigned int depth = 0;
+    for (PropertyTreeNode* a = n->parent; a; a = a->parent) {
+        depth++;
+        if (!a->indexed)
+            continue;
+        for (unsigned int i = 0; i < indexes.size(); i++) {
+            PropertyIndex* index = indexes[i];
+            if (index->node != a || index->columnar || !index->built ||
+                index->version != a->subtreeVersion)
+                continue;
+            if (depth == 2 && n->key == index->key) {
+                unsigned int row = strtoul(n->parent->key->str.c_str(), NULL, 10);
+                if (!a->IsArray() || a->FindIdx(row) != n->parent ||
+                    !index->UpdateRow(row))
+                    continue;
+            }
+            index->version = v;
+            // the next change must not share the version
+            versionObserved = true;
+        }
+    }
+}
+
+void PropertyTree::QueueThrottle(PropertyThrottle* t) {
+    queuedThrottles.push_back(t);
+}
+
+/**
+ * Counts a frame and delivers the throttled changes that are due.
+ * Throttles that are not due yet keep their merged flags for a later
+ * frame.
+ */
+void PropertyTree::FlushThrottles() {
+    frame++;
+    if (queuedThrottles.empty())
+        return;
+    unsigned long long now = Timer::GetTime().AsInt();
+    unsigned int keep = 0;
+    for (unsigned int i = 0; i < queuedThrottles.size(); i++) {
+        PropertyThrottle* t = queuedThrottles[i];
+        if (t->listener && !t->IsReady(frame, now)) {
+            queuedThrottles[keep++] = t;
+            continue;
+        }
+        if (t->listener)
+            t->Deliver(frame, now);
+        if (!t->listener)
+            delete t;
+        else if (t->flags)
+            // changed again while it was delivered
+            queuedThrottles[keep++] = t;
+        else
+            t->queued = false;
+    }
+    queuedThrottles.resize(keep);
+}
+
+/**
+ * Limits the notifications sent by each Handle to a time in
+ * microseconds and/or a number of nodes. Zero means no limit. At least
+ * one node is notified per tick, the rest carry over in order.
+ */
+void PropertyTree::SetDispatchBudget(unsigned int usec, unsigned int count) {
+    budgetTime = usec;
+    budgetCount = count;
+}
+
+/**
+ * Sends all queued notifications right away, ignoring the budget.
+ * Does nothing inside a transaction or when called by a listener
+ * while events are dispatched. Changes made by that listener are
+ * sent by the pass in progress or by the next one.
+ */
+void PropertyTree::FlushEvents() {
+    if (transactionDepth || dispatching)
+        return;
+    if (!dispatchList.empty())
+        DispatchEvents(false);
+    DispatchEvents(false);
 }
     
 bool PropertyTree::HaveKey(std::string p, std::string k) {
@@ -54,7 +525,7 @@ const YAML::Node* PropertyTree::NodeForKeyPath(string key) {
     using namespace boost;
     vector<string> paths;
     split(paths,key,is_any_of("."));
-    const YAML::Node* node = &doc;
+    const YAML::Node* node = doc;
 
     for (vector<string>::iterator itr = paths.begin();
          itr != paths.end();
@@ -67,7 +538,14 @@ const YAML::Node* PropertyTree::NodeForKeyPath(string key) {
     return node;
 }
 
-PropertyTreeNode* PropertyTree::LoadYamlSeq(PropertyTreeNode* r, const YAML::Node& n) {
+/**
+ * A type given for the elements is a hint for every scalar element
+ * without a tag of its own.
+ */
+PropertyTreeNode* PropertyTree::LoadYamlSeq(PropertyTreeNode* r, const YAML::Node& n,
+                                            PropertyType elementType) {
+    if (LoadPackedSeq(r, n, elementType) || LoadRecordSeq(r, n))
+        return r;
     r->kind = PropertyTreeNode::ARRAY;
     
     int i=0;
@@ -76,6 +554,8 @@ PropertyTreeNode* PropertyTree::LoadYamlSeq(PropertyTreeNode* r, const YAML::Nod
         
         const YAML::Node& valNode = *it;
 
+        if (valNode.GetType() == YAML::CT_SCALAR && elementType != UNKNOWN)
+            n->type = elementType;
         LoadYamlNode(n, valNode);
     }
 
@@ -83,6 +563,154 @@ PropertyTreeNode* PropertyTree::LoadYamlSeq(PropertyTreeNode* r, const YAML::Nod
     return r;
 }
 
+/**
+ * Sequences of plain numbers are loaded into a PACKED node. Quoted
+ * and tagged items are not plain, quotes carry the non-specific tag
+ * "!". Elements of a type packed arrays do not hold, like double or
+ * str, are not packed either. Returns false, leaving r alone, for any
+ * other sequence.
+ */
+bool PropertyTree::LoadPackedSeq(PropertyTreeNode* r, const YAML::Node& n,
+                                 PropertyType elementType) {
+    PropertyType hint = elementType != UNKNOWN ? elementType : r->type;
+    if (hint != UNKNOWN && hint != INT32 && hint != FLOAT &&
+        hint != VEC3F && hint != RGBACOLOR)
+        return false;
+    vector<string> items;
+    items.reserve(n.size());
+    for(YAML::Iterator it=n.begin();it!=n.end();++it) {
+        const YAML::Node& valNode = *it;
+        if (valNode.GetType() != YAML::CT_SCALAR || !valNode.GetTag().empty())
+            return false;
+        string v;
+        valNode >> v;
+        items.push_back(v);
+    }
+    PropertyPackedArray packed;
+    if (!PropertyPackedArray::Parse(items, hint, packed))
+        return false;
+    r->Pack();
+    *r->packed = packed;
+    r->isSet = true;
+    return true;
+}
+
+/**
+ * Sequences of at least MIN_RECORDS maps that all have the same keys
+ * are loaded into a RECORDS node, provided every key holds scalars or
+ * number sequences of one length in all records. Keys are stored as
+ * numbers by the rules of LoadPackedSeq, keys with quoted texts keep
+ * them as values. Returns false, leaving r alone, for any other
+ * sequence.
+ */
+bool PropertyTree::LoadRecordSeq(PropertyTreeNode* r, const YAML::Node& n) {
+    unsigned int size = n.size();
+    if (size < PropertyRecordTable::MIN_RECORDS)
+        return false;
+    YAML::Iterator it = n.begin();
+    if (it->GetType() != YAML::CT_MAP || it->size() == 0)
+        return false;
+    vector<string> keys;
+    for (YAML::Iterator kt = it->begin(); kt != it->end(); ++kt) {
+        string key;
+        kt.first() >> key;
+        keys.push_back(key);
+    }
+    sort(keys.begin(), keys.end());
+    if (adjacent_find(keys.begin(), keys.end()) != keys.end())
+        return false;
+
+    // the texts of each key, with the width of its sequences or 0
+    // for scalars, its type hint and whether any text was quoted
+    vector<vector<string> > texts(keys.size());
+    vector<unsigned int> widths(keys.size(), 0);
+    vector<PropertyType> hints(keys.size(), UNKNOWN);
+    vector<bool> quoted(keys.size(), false);
+    for (unsigned int i = 0; it != n.end(); ++it, i++) {
+        const YAML::Node& record = *it;
+        if (record.GetType() != YAML::CT_MAP || record.size() != keys.size())
+            return false;
+        for (unsigned int c = 0; c < keys.size(); c++) {
+            const YAML::Node* valNode = record.FindValue(keys[c]);
+            if (!valNode)
+                return false;
+            PropertyType hint = TypeFromName(valNode->GetTag());
+            if (hint != UNKNOWN) {
+                if (hints[c] != UNKNOWN && hints[c] != hint)
+                    return false;
+                hints[c] = hint;
+            } else if (!valNode->GetTag().empty())
+                quoted[c] = true;
+            unsigned int width = 0;
+            if (valNode->GetType() == YAML::CT_SEQUENCE) {
+                width = valNode->size();
+                if (width == 0)
+                    return false;
+                for (YAML::Iterator et = valNode->begin(); et != valNode->end(); ++et) {
+                    if (et->GetType() != YAML::CT_SCALAR || !et->GetTag().empty())
+                        return false;
+                    string v;
+                    *et >> v;
+                    texts[c].push_back(v);
+                }
+            } else if (valNode->GetType() == YAML::CT_SCALAR) {
+                string v;
+                *valNode >> v;
+                texts[c].push_back(v);
+            } else
+                return false;
+            if (i == 0)
+                widths[c] = width;
+            else if (widths[c] != width)
+                return false;
+        }
+    }
+
+    PropertyRecordTable* table = new PropertyRecordTable(size);
+    for (unsigned int c = 0; c < keys.size(); c++) {
+        PropertyType hint = hints[c];
+        // like packed sequences, see LoadPackedSeq
+        bool numeric = !quoted[c] &&
+            (hint == UNKNOWN || hint == INT32 || hint == FLOAT);
+        if (widths[c]) {
+            PropertyColumn col(atoms.Intern(keys[c]), PropertyColumn::TUPLE, widths[c]);
+            numeric |= hint == VEC3F || hint == RGBACOLOR;
+            if (!numeric || !PropertyPackedArray::Parse(texts[c], hint, col.numbers)) {
+                delete table;
+                return false;
+            }
+            table->AddColumn(col);
+            continue;
+        }
+        PropertyColumn col(atoms.Intern(keys[c]), PropertyColumn::NUMBER, 1);
+        if (!numeric || !PropertyPackedArray::Parse(texts[c], hint, col.numbers)) {
+            col.kind = PropertyColumn::VALUE;
+            col.values.reserve(size);
+            for (unsigned int i = 0; i < size; i++)
+                col.values.push_back(MakeValue(texts[c][i], hint));
+        }
+        table->AddColumn(col);
+    }
+    r->kind = PropertyTreeNode::RECORDS;
+    r->records = table;
+    return true;
+}
+
+/**
+ * Value for text from a file. Short texts are interned and texts of
+ * a known type are converted right away.
+ */
+PropertyValue PropertyTree::MakeValue(const string& v, PropertyType type) {
+    PropertyValue value;
+    if (v.size() <= PropertyAtomTable::MAX_VALUE_LENGTH)
+        value.SetText(atoms.InternValue(v));
+    else
+        value.SetText(v);
+    if (type != STRING)
+        value.ConvertTo(type);
+    return value;
+}
+
 PropertyTreeNode* PropertyTree::LoadYamlMap(PropertyTreeNode* r, const YAML::Node& n) {
     r->kind = PropertyTreeNode::MAP;
     for(YAML::Iterator it=n.begin();it!=n.end();++it) {
@@ -101,10 +729,18 @@ PropertyTreeNode* PropertyTree::LoadYamlMap(PropertyTreeNode* r, const YAML::Nod
 
 
 PropertyTreeNode* PropertyTree::LoadYamlNode(PropertyTreeNode* r, const YAML::Node& n) {
+    PropertyType hint = TypeFromName(n.GetTag());
+    // a scalar type on a sequence is the type of its elements, only
+    // vectors and colors are read from the whole sequence
+    PropertyType elementType = UNKNOWN;
+    if (n.GetType() == YAML::CT_SEQUENCE && hint != VEC3F && hint != RGBACOLOR)
+        swap(hint, elementType);
+    if (hint != UNKNOWN)
+        r->type = hint;
     if (n.GetType() == YAML::CT_MAP) {
         LoadYamlMap(r, n);
     } else if (n.GetType() == YAML::CT_SEQUENCE) {
-        LoadYamlSeq(r, n);        
+        LoadYamlSeq(r, n, elementType);
     } else if (n.GetType() == YAML::CT_SCALAR) {        
         r->kind = PropertyTreeNode::SCALAR;
         string v;
@@ -116,17 +752,287 @@ PropertyTreeNode* PropertyTree::LoadYamlNode(PropertyTreeNode* r, const YAML::No
 }
 
 
-void PropertyTree::LoadFromFile(string file) {
+void PropertyTree::ClearMap(PropertyTreeNode* n) {
+    if (n->subNodes.empty())
+        return;
+    for (PropertyNodeMap::iterator itr = n->subNodes.begin();
+         itr != n->subNodes.end();
+         itr++) {
+        RemoveNode(itr->second);
+    }
+    n->subNodes.clear();
+    n->SetDirty(PropertiesChangedEventArg::STRUCTURE);
+    generation++;
+}
+
+void PropertyTree::ResizeArray(PropertyTreeNode* n, unsigned int size) {
+    if (n->subNodesArray.size() <= size)
+        return;
+    for (unsigned int i = size; i < n->subNodesArray.size(); i++)
+        RemoveNode(n->subNodesArray[i]);
+    n->subNodesArray.resize(size);
+    n->SetDirty(PropertiesChangedEventArg::STRUCTURE);
+    generation++;
+}
+
+/**
+ * Bring dst in line with the freshly loaded src node. Only nodes
+ * that actually differ are marked dirty, and nodes that were loaded
+ * earlier but are no longer present in src are removed from dst.
+ * Nodes created from code (defaults) are left alone.
+ */
+void PropertyTree::MergeNode(PropertyTreeNode* dst, PropertyTreeNode* src) {
+    dst->isLoaded = true;
+    // type hints only fill in types that are not known yet
+    if (dst->type == UNKNOWN)
+        dst->type = src->type;
+    // an array built element by element keeps its element nodes
+    if ((src->kind == PropertyTreeNode::PACKED ||
+         src->kind == PropertyTreeNode::RECORDS) &&
+        dst->kind == PropertyTreeNode::ARRAY)
+        src->Unpack();
+    if (dst->kind != src->kind) {
+        if (dst->kind == PropertyTreeNode::MAP)
+            ClearMap(dst);
+        else if (dst->kind == PropertyTreeNode::ARRAY)
+            ResizeArray(dst, 0);
+        else if (dst->kind == PropertyTreeNode::PACKED)
+            dst->ClearPacked();
+        else if (dst->kind == PropertyTreeNode::RECORDS) {
+            dst->ClearRecords();
+            generation++;
+        }
+        dst->kind = src->kind;
+        dst->SetDirty(PropertiesChangedEventArg::STRUCTURE);
+    }
+
+    if (src->kind == PropertyTreeNode::MAP) {
+        for (PropertyNodeMap::iterator itr = src->subNodes.begin();
+             itr != src->subNodes.end();
+             itr++) {
+            MergeNode(dst->GetNode(itr->first->str), itr->second);
+        }
+        PropertyNodeMap::iterator itr = dst->subNodes.begin();
+        while (itr != dst->subNodes.end()) {
+            const string& key = itr->first->str;
+            if (src->FindNode(key.data(), key.size()) || !itr->second->isLoaded) {
+                itr++;
+                continue;
+            }
+            RemoveNode(itr->second);
+            itr = dst->subNodes.erase(itr);
+            dst->SetDirty(PropertiesChangedEventArg::STRUCTURE);
+            generation++;
+        }
+    } else if (src->kind == PropertyTreeNode::ARRAY) {
+        for (unsigned int i = 0; i < src->subNodesArray.size(); i++)
+            MergeNode(dst->GetNodeIdx(i), src->subNodesArray[i]);
+        ResizeArray(dst, src->subNodesArray.size());
+    } else if (src->kind == PropertyTreeNode::PACKED) {
+        if (!dst->packed)
+            dst->packed = new PropertyPackedArray(*src->packed);
+        else {
+            // ints that have been read as floats are loaded as floats
+            if (dst->packed->GetElementType() == FLOAT)
+                src->packed->ConvertTo(FLOAT);
+            if (*dst->packed == *src->packed)
+                return;
+            *dst->packed = *src->packed;
+        }
+        dst->isSet = true;
+        dst->SetDirty(PropertiesChangedEventArg::VALUE);
+    } else if (src->kind == PropertyTreeNode::RECORDS) {
+        MergeRecords(dst, src);
+    } else if (src->kind == PropertyTreeNode::SCALAR && src->isSet) {
+        // the loaded value was built on the loader thread. Only text
+        // for a value that is kept natively here is parsed again.
+        dst->isSet = true;
+        if (dst->value.SameText(src->value))
+            return;
+        PropertyType native = dst->value.GetType();
+        if (native == STRING || native == UNKNOWN)
+            native = dst->type;
+        src->value.ConvertTo(native);
+        if (dst->value != src->value) {
+            dst->value = src->value;
+            dst->value.Intern(atoms);
+            dst->SetDirty(PropertiesChangedEventArg::VALUE);
+        }
+    }
+}
+
+/**
+ * Merges a loaded record table into dst. If the columns are the same
+ * only the cells that differ are copied. Record nodes that exist for
+ * them are updated and marked dirty, other changed records mark the
+ * table node itself. Different columns replace the whole table.
+ */
+void PropertyTree::MergeRecords(PropertyTreeNode* dst, PropertyTreeNode* src) {
+    PropertyRecordTable& from = *src->records;
+    if (!dst->records || !dst->records->SameSchema(from)) {
+        if (dst->records) {
+            dst->ClearRecords();
+            dst->SetDirty(PropertiesChangedEventArg::STRUCTURE);
+            generation++;
+        }
+        dst->records = new PropertyRecordTable(from.GetSize());
+        for (unsigned int c = 0; c < from.GetColumnCount(); c++) {
+            PropertyColumn col = from.GetColumn(c);
+            col.key = atoms.Intern(col.key->str);
+            for (unsigned int i = 0; i < col.values.size(); i++)
+                col.values[i].Intern(atoms);
+            dst->records->AddColumn(col);
+        }
+        dst->SetDirty(PropertiesChangedEventArg::VALUE);
+        return;
+    }
+
+    PropertyRecordTable& to = *dst->records;
+    unsigned int flags = 0;
+    if (to.GetSize() != from.GetSize()) {
+        for (unsigned int i = from.GetSize(); i < to.GetSize(); i++) {
+            if (to.rows[i]) {
+                RemoveNode(to.rows[i]);
+                generation++;
+            }
+        }
+        to.Resize(from.GetSize());
+        flags |= PropertiesChangedEventArg::STRUCTURE;
+    }
+    for (unsigned int c = 0; c < to.GetColumnCount(); c++) {
+        PropertyColumn& col = to.GetColumn(c);
+        PropertyColumn& loaded = from.GetColumn(c);
+        // ints that have been read as floats are loaded as floats,
+        // like SetValue values are kept in their native form
+        if (col.kind != PropertyColumn::VALUE) {
+            if (col.numbers.GetElementType() == FLOAT)
+                loaded.ConvertTo(FLOAT);
+            else if (loaded.numbers.GetElementType() == FLOAT)
+                col.ConvertTo(FLOAT);
+        } else {
+            for (unsigned int i = 0; i < to.GetSize(); i++) {
+                if (!col.values[i].SameText(loaded.values[i]))
+                    loaded.values[i].ConvertTo(col.values[i].GetType());
+            }
+        }
+        for (unsigned int i = 0; i < to.GetSize(); i++) {
+            if (!col.Merge(i, loaded))
+                continue;
+            if (col.kind == PropertyColumn::VALUE)
+                col.values[i].Intern(atoms);
+            // subscribers to the record or the cell need its node
+            if (!to.rows[i] && !IsSubscribed(dst, i, col.key)) {
+                flags |= PropertiesChangedEventArg::VALUE;
+                continue;
+            }
+            bool created = !to.rows[i];
+            PropertyTreeNode* cell = dst->GetRecord(i)->subNodes.Find(col.key);
+            if (to.LoadCell(i, c, cell) || created)
+                cell->SetDirty(PropertiesChangedEventArg::VALUE);
+        }
+    }
+    if (flags)
+        dst->SetDirty(PropertiesChangedEventArg::ChangeFlag(flags));
+}
+
+/**
+ * True if a subscription matches record row of table, or its cell
+ * for key. Used for records that have no node yet.
+ */
+bool PropertyTree::IsSubscribed(PropertyTreeNode* table, unsigned int row,
+                                const PropertyAtom* key) {
+    if (subscriptions.IsEmpty())
+        return false;
+    keyPath.clear();
+    for (PropertyTreeNode* n = table; n != root; n = n->parent)
+        keyPath.push_back(n->key);
+    reverse(keyPath.begin(), keyPath.end());
+    // a row no node has been created for may have no atom, only
+    // wildcards match it then
+    keyPath.push_back(atoms.Find(Convert::ToString(row)));
+    unsigned int begin = subscribers.size();
+    // the record only changes below, the cell itself
+    subscriptions.Match(keyPath, subscribers, false);
+    keyPath.push_back(key);
+    subscriptions.Match(keyPath, subscribers);
+    bool found = subscribers.size() > begin;
+    subscribers.resize(begin);
+    return found;
+}
+
+/**
+ * Parse file into d and build the scratch tree shadow from it. Does
+ * not touch any live tree, so it is safe to run on a worker thread.
+ * Returns false if the file could not be read or held no document.
+ */
+bool PropertyTree::ParseFile(string file, YAML::Node& d, PropertyTree& shadow) {
     ifstream fin(file.c_str());
+    if (!fin)
+        return false;
 
     YAML::Parser parser(fin);
-    parser.GetNextDocument(doc);
+    if (!parser.GetNextDocument(d))
+        return false;
 
-    LoadYamlNode(root,doc);
+    shadow.LoadYamlNode(shadow.root, d);
 
     fin.close();
-    
-    reloadTimer.Start();
+    return true;
+}
+
+/**
+ * Merge a freshly loaded scratch tree into the live tree, so
+ * listeners only hear about the nodes that changed since the last
+ * load. Takes ownership of newDoc.
+ */
+void PropertyTree::ApplyLoad(YAML::Node* newDoc, PropertyTree& shadow) {
+    delete doc;
+    doc = newDoc;
+    MergeNode(root, shadow.root);
+    // hand the scratch nodes back to its pool for the next load
+    shadow.ClearRoot();
+}
+
+/**
+ * The scratch tree loads are built in. It is kept between reloads
+ * so its nodes are recycled instead of allocated again. The loader
+ * thread has its own, so a synchronous load never touches a tree the
+ * thread may be building.
+ */
+PropertyTree* PropertyTree::GetScratchTree(bool loaderThread) {
+    PropertyTree*& tree = loaderThread ? loaderScratch : scratch;
+    if (!tree)
+        tree = new PropertyTree();
+    return tree;
+}
+
+void PropertyTree::ClearRoot() {
+    DestroyNode(root);
+    dirtyNodes.clear();
+    root = CreateNode(NULL, NULL);
+}
+
+void PropertyTree::LoadFromFile(string file) {
+    YAML::Node* newDoc = new YAML::Node();
+    PropertyTree& shadow = *GetScratchTree(false);
+    unsigned int serial = ++loadSerial;
+    bool ok;
+    try {
+        ok = ParseFile(file, *newDoc, shadow);
+    } catch (...) {
+        shadow.ClearRoot();
+        delete newDoc;
+        throw;
+    }
+    if (!ok) {
+        logger.error << "Could not load " << file << logger.end;
+        shadow.ClearRoot();
+        delete newDoc;
+        return;
+    }
+    ApplyLoad(newDoc, shadow);
+    appliedSerial = serial;
+    PublishSnapshot();
 }
 
 
@@ -135,11 +1041,14 @@ void PropertyTree::Reload(bool skipTS) {
         DateTime newTimestamp = Resources::File::GetLastModified(filename);    
         lastTimestamp = newTimestamp;
     }
+    unsigned int oldDirtyCount = dirtyCount;
     LoadFromFile(filename);
     logger.info << "Reloading" << logger.end;
 
-    PropertiesChangedEventArg arg(root);
-    changedEvent.Notify(arg);
+    if (dirtyCount != oldDirtyCount) {
+        PropertiesChangedEventArg arg(root);
+        changedEvent.Notify(arg);
+    }
 }
 
 
@@ -148,41 +1057,97 @@ public:
     YAML::Emitter out;
     PropertyTree *tree;
     bool comments;
+    bool typeHints;
 
-    Emitter(PropertyTree* t, bool comments) : tree(t), comments(comments) {}
+    Emitter(PropertyTree* t, bool comments, bool typeHints)
+        : tree(t), comments(comments), typeHints(typeHints) {}
     
     void EmitArray(PropertyTreeNode* node) {
         if (node->GetType() == PropertyTree::VEC3F) {
             out << YAML::Flow;
         }
         out << YAML::BeginSeq;
+        // the element types of vectors and colors are implied
+        bool hints = typeHints;
+        if (node->GetType() == PropertyTree::VEC3F ||
+            node->GetType() == PropertyTree::RGBACOLOR)
+            typeHints = false;
         for (vector<PropertyTreeNode*>::iterator itr = node->subNodesArray.begin();
              itr != node->subNodesArray.end();
              itr++) {
             Emit(*itr);
         }
+        typeHints = hints;
+        out << YAML::EndSeq;
+    }
+    void EmitPacked(const PropertyPackedArray& packed) {
+        out << YAML::Flow << YAML::BeginSeq;
+        for (unsigned int i = 0; i < packed.GetSize(); i++)
+            out << packed.GetElement(i).ToString();
+        out << YAML::EndSeq;
+    }
+    void EmitRecords(PropertyTreeNode* node) {
+        const PropertyRecordTable& records = *node->records;
+        out << YAML::BeginSeq;
+        for (unsigned int i = 0; i < records.GetSize(); i++) {
+            out << YAML::BeginMap;
+            for (unsigned int c = 0; c < records.GetColumnCount(); c++) {
+                const PropertyColumn& col = records.GetColumn(c);
+                out << YAML::Key << col.key->str;
+                out << YAML::Value;
+                if (col.kind == PropertyColumn::TUPLE) {
+                    PropertyPackedArray tuple;
+                    col.GetTuple(i, tuple);
+                    if (typeHints)
+                        out << YAML::VerbatimTag(TypeToName(tuple.GetElementType()));
+                    EmitPacked(tuple);
+                    continue;
+                }
+                PropertyValue v = col.GetValue(i);
+                if (typeHints && v.GetType() != PropertyTree::STRING &&
+                    v.GetType() != PropertyTree::UNKNOWN)
+                    out << YAML::VerbatimTag(TypeToName(v.GetType()));
+                out << v.ToString();
+            }
+            out << YAML::EndMap;
+        }
         out << YAML::EndSeq;
     }
     void EmitMap(PropertyTreeNode* node) {
         out << YAML::BeginMap;
-        for (map<string,PropertyTreeNode*>::iterator itr = node->subNodes.begin();
-             itr != node->subNodes.end();
+        vector<PropertyNodeMap::Entry*> sorted;
+        node->subNodes.GetSorted(sorted);
+        for (vector<PropertyNodeMap::Entry*>::iterator itr = sorted.begin();
+             itr != sorted.end();
              itr++) {
-            out << YAML::Key << itr->first;
+            out << YAML::Key << (*itr)->first->str;
             out << YAML::Value;
-            Emit(itr->second);
+            Emit((*itr)->second);
         }
         out << YAML::EndMap;
     }
 
     void Emit(PropertyTreeNode* node) {
+        PropertyTree::PropertyType type = node->GetType();
+        // without a tag float elements that happen to be whole
+        // numbers would load as ints
+        if (type == PropertyTree::UNKNOWN &&
+            node->kind == PropertyTreeNode::PACKED)
+            type = node->packed->GetElementType();
+        if (typeHints && node->kind != PropertyTreeNode::MAP &&
+            type != PropertyTree::UNKNOWN)
+            out << YAML::VerbatimTag(TypeToName(type));
         if (node->kind == PropertyTreeNode::MAP) {
             EmitMap(node);
         } else if (node->kind == PropertyTreeNode::ARRAY) {
             EmitArray(node);
+        } else if (node->kind == PropertyTreeNode::PACKED) {
+            EmitPacked(*node->packed);
+        } else if (node->kind == PropertyTreeNode::RECORDS) {
+            EmitRecords(node);
         
         } else if (node->kind == PropertyTreeNode::SCALAR) {
-            out << node->value;
+            out << node->value.ToString();
             if (comments && !node->HaveBeenRead())
                 out << YAML::Comment("Never read");
         }        
@@ -201,7 +1166,7 @@ void PropertyTree::SaveWithComments() {
 
 void PropertyTree::SaveToFile(string file, bool comments) {
     
-    Emitter e(this,comments);
+    Emitter e(this,comments,saveTypeHints);
     
     e.Emit(root);
     
@@ -212,29 +1177,110 @@ void PropertyTree::SaveToFile(string file, bool comments) {
 }
 
 
-void PropertyTree::Handle(Core::ProcessEventArg arg) {
-    if (reloadTimer.GetElapsedIntervals(1000000)) {
-        reloadTimer.Reset();
-        ReloadIfNeeded();
-    }
-    if (dirtySet.size()) {
-        for(set<pair<PropertyTreeNode*,PropertiesChangedEventArg::ChangeFlag> >::iterator itr = dirtySet.begin();
-            itr != dirtySet.end();
-            itr++) {
-            PropertyTreeNode* n = itr->first;
-            PropertiesChangedEventArg::ChangeFlag flag = itr->second;
-            PropertiesChangedEventArg arg(n, flag);
-            n->PropertiesChangedEvent().Notify(arg);            
+void PropertyTree::FinishReload() {
+    loader->Wait();
+    if (loader->serial < appliedSerial) {
+        // a synchronous load of a newer file has been applied since
+        loader->shadow.ClearRoot();
+    } else if (loader->ok) {
+        unsigned int oldDirtyCount = dirtyCount;
+        ApplyLoad(loader->doc, loader->shadow);
+        loader->doc = NULL;
+        appliedSerial = loader->serial;
+        logger.info << "Reloading" << logger.end;
+
+        if (dirtyCount != oldDirtyCount) {
+            PropertiesChangedEventArg arg(root);
+            changedEvent.Notify(arg);
         }
-        dirtySet.clear();
+    } else {
+        logger.error << "Reloading " << filename << " failed: " 
+                     << loader->error << logger.end;
+        loader->shadow.ClearRoot();
     }
+    delete loader;
+    loader = NULL;
+}
 
+void PropertyTree::Handle(Core::ProcessEventArg arg) {
+    // parsing happens on a worker thread, only the merge of the
+    // result into the live tree is done here.
+    if (loader && loader->done.Get())
+        FinishReload();
+    if (watcher && watcher->HasChanged())
+        reloadRequested = true;
+    if (reloadRequested && !loader) {
+        reloadRequested = false;
+        loader = new PropertyTreeLoader(filename, *GetScratchTree(true),
+                                        ++loadSerial);
+        loader->Start();
+    }
+
+    if (transactionDepth)
+        return;
+    if (!dirtyNodes.empty() || !dispatchList.empty())
+        DispatchEvents(true);
+    FlushThrottles();
+    if (!removedNodes.empty())
+        SweepRemovedNodes();
+
+    PublishSnapshot();
 }
 
+/**
+ * Read only view of the tree as of the last published snapshot. Can
+ * be called from any thread. The root of the view is NULL until the
+ * tree has been loaded or handled once.
+ */
+PropertySnapshot PropertyTree::Snapshot() {
+    return PropertySnapshot(snapshots);
+}
+
+/**
+ * Publish the current state of the tree to snapshot readers. Handle
+ * does this once per frame, only the changed parts are copied.
+ */
+void PropertyTree::PublishSnapshot() {
+    if (transactionDepth) return;
+    snapshots->Publish(root);
+}
+
+/**
+ * Starts buffering changes. Values and node and subtree versions are
+ * still updated right away, but dirty flags are not propagated to
+ * ancestors and nothing is dispatched or published until the
+ * matching Commit.
+ */
+void PropertyTree::BeginTransaction() {
+    transactionDepth++;
+}
+
+void PropertyTree::Commit() {
+    if (!transactionDepth || --transactionDepth)
+        return;
+    // ancestors appended while marking have nothing pending
+    for (unsigned int i = 0; i < dirtyNodes.size(); i++) {
+        PropertyTreeNode* n = dirtyNodes[i];
+        if (n && n->pendingFlags)
+            n->PropagateDirty();
+    }
+    for (unsigned int i = 0; i < dispatchList.size(); i++) {
+        PropertyTreeNode* n = dispatchList[i].node;
+        if (n && n->pendingFlags)
+            n->PropagateDirty();
+    }
+}
+
+/**
+ * Polling fallback for trees whose file is not watched. If the file
+ * changed since it was last seen the next Handle reloads it on the
+ * loader thread, like a change the watcher reports.
+ */
 void PropertyTree::ReloadIfNeeded() {
     DateTime newTimestamp = Resources::File::GetLastModified(filename);
     if (newTimestamp != lastTimestamp) {
-        Reload();
+        lastTimestamp = newTimestamp;
+        reloadRequested = true;
     }
 }
 
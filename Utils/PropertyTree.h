@@ -12,8 +12,11 @@
 #define _OE_PROPERTY_TREE2_H_
 
 #include <string>
-#include <set>
+#include <vector>
 #include "yaml/yaml.h"
+#include "PropertyNodePool.h"
+#include "PropertyAtomTable.h"
+#include "PropertySubscriptions.h"
 
 #include <Core/Event.h>
 #include <Core/EngineEvents.h>
@@ -24,10 +27,18 @@ namespace OpenEngine {
 namespace Utils {
 
 class PropertyTreeNode;
+class FileWatcher;
+class PropertyTreeLoader;
+class PropertySnapshot;
+class PropertySnapshots;
+class PropertyThrottle;
+class PropertyValue;
+class PropertyIndex;
 
 using namespace std;
 
 class PropertiesChangedEventArg {
+    friend class PropertyTree;
 public:    
     enum ChangeFlag {
         VALUE = 1 << 0,         // 1
@@ -48,6 +59,31 @@ public:
     bool IsTypeChange() { return flags & TYPE; }
     bool IsRecursive() { return flags & IS_RECURSIVE; }
     bool IsStructureChange() { return flags & STRUCTURE; }
+    ChangeFlag GetFlags() { return flags; }
+};
+
+/**
+ * All changes in the subtree of a node from one Handle tick. The
+ * changes are ordered children before parents and the last one is the
+ * node itself. A node removed while the batch was being dispatched is
+ * left in the span with a NULL node.
+ */
+class PropertiesChangedBatchEventArg {
+private:
+    PropertyTreeNode* node;
+    PropertiesChangedEventArg* first;
+    PropertiesChangedEventArg* last;
+
+public:
+    PropertiesChangedBatchEventArg(PropertyTreeNode* n,
+                                   PropertiesChangedEventArg* b,
+                                   PropertiesChangedEventArg* e)
+  : node(n), first(b), last(e) {}
+    PropertyTreeNode* GetNode() { return node; }
+    unsigned int GetSize() { return last - first; }
+    PropertiesChangedEventArg* begin() { return first; }
+    PropertiesChangedEventArg* end() { return last; }
+    PropertiesChangedEventArg& operator[](unsigned int i) { return first[i]; }
 };
 
 /**
@@ -57,22 +93,109 @@ public:
  */
 class PropertyTree : public Core::IListener<Core::ProcessEventArg> {
     friend class PropertyTreeNode;    
+    friend class PropertyTreeLoader;
+    friend class PropertyThrottle;
 protected:    
-    void AddToDirtySet(PropertyTreeNode* n, PropertiesChangedEventArg::ChangeFlag f);
+    void AddToDirtySet(PropertyTreeNode* n);
+    void RemoveFromDirtySet(PropertyTreeNode* n);
+
+    PropertyTreeNode* CreateNode(PropertyTreeNode* parent, const PropertyAtom* key);
+    void DestroyNode(PropertyTreeNode* n);
+    void RemoveNode(PropertyTreeNode* n);
+    void SweepRemovedNodes();
+
+    PropertyThrottle* AddThrottle(PropertyTreeNode* n,
+                                  Core::IListener<PropertiesChangedEventArg>& l,
+                                  unsigned int interval, unsigned int frames);
+    void RemoveThrottle(PropertyThrottle* t);
+    void RemoveThrottles(PropertyTreeNode* n,
+                         Core::IListener<PropertiesChangedEventArg>* l=NULL);
+    void QueueThrottle(PropertyThrottle* t);
+    void FlushThrottles();
+    PropertyIndex* AddIndex(PropertyTreeNode* n, const string& key);
+    void RemoveIndexes(PropertyTreeNode* n, const PropertyAtom* key=NULL);
+    void UpdateIndexes(PropertyTreeNode* n, unsigned int f, unsigned int v);
+    void NotifySubscribers(PropertiesChangedEventArg& arg, bool changed);
+
+    /**
+     * The clock only advances when a version has been read since the
+     * last change, so a burst of changes shares one version and
+     * marking ancestors can stop at the first one that has it.
+     */
+    unsigned int NextVersion() {
+        if (versionObserved) {
+            versionClock++;
+            versionObserved = false;
+        }
+        return versionClock;
+    }
 
 private:
-    set<pair<PropertyTreeNode*,PropertiesChangedEventArg::ChangeFlag> > dirtySet;
+    vector<PropertyTreeNode*> dirtyNodes;
+    vector<PropertyTreeNode*> dirtyRoots;
+    vector<pair<PropertyTreeNode*, unsigned int> > dispatchStack;
+    vector<PropertiesChangedEventArg> dispatchList;
+    vector<unsigned int> spanBegins;
+    vector<PropertyThrottle*> throttles;
+    vector<PropertyThrottle*> queuedThrottles;
+    vector<PropertyIndex*> indexes;
+    vector<PropertyTreeNode*> removedNodes;
+    PropertyNodePool pool;
+    PropertyAtomTable atoms;
+    PropertySubscriptions subscriptions;
+    vector<const PropertyAtom*> keyPath;
+    vector<PropertySubscriptions::Listener*> subscribers;
     PropertyTreeNode* root;
-    YAML::Node doc;
+    YAML::Node* doc;
+    unsigned int generation;
+    unsigned int dirtyCount;
+    unsigned int transactionDepth;
+    unsigned int dispatchPos;
+    unsigned int queuedEvents;
+    unsigned int budgetTime;
+    unsigned int budgetCount;
+    unsigned int frame;
+    // set while DispatchEvents runs, listeners can not start a pass
+    bool dispatching;
+    // set by the destructor, nodes skip unlinking themselves
+    bool destroying;
+    unsigned int versionClock;
+    bool versionObserved;
+    bool saveTypeHints;
 
     std::string filename;
 
     PropertyTreeNode* LoadYamlMap(PropertyTreeNode* r, const YAML::Node& n);
-    PropertyTreeNode* LoadYamlSeq(PropertyTreeNode* r, const YAML::Node& n);
+    bool LoadRecordSeq(PropertyTreeNode* r, const YAML::Node& n);
     PropertyTreeNode* LoadYamlNode(PropertyTreeNode* r, const YAML::Node& n);
 
-    Timer reloadTimer;
+    void MergeNode(PropertyTreeNode* dst, PropertyTreeNode* src);
+    void MergeRecords(PropertyTreeNode* dst, PropertyTreeNode* src);
+    bool IsSubscribed(PropertyTreeNode* table, unsigned int row,
+                      const PropertyAtom* key);
+    void ClearMap(PropertyTreeNode* n);
+    void ResizeArray(PropertyTreeNode* n, unsigned int size);
+
+    static bool ParseFile(std::string file, YAML::Node& d, PropertyTree& shadow);
+    void ApplyLoad(YAML::Node* newDoc, PropertyTree& shadow);
+    void FinishReload();
+    PropertyTree* GetScratchTree(bool loaderThread);
+    void ClearRoot();
+    void OrderDirtyNodes();
+    bool DispatchEvents(bool limited);
+
     DateTime lastTimestamp;
+    FileWatcher* watcher;
+    PropertyTreeLoader* loader;
+    bool reloadRequested;
+
+    PropertySnapshots* snapshots;
+    PropertyTree* scratch;
+    PropertyTree* loaderScratch;
+    // loads are numbered when they start, results older than the
+    // last one applied are dropped
+    unsigned int loadSerial;
+    unsigned int appliedSerial;
 
     Core::Event<PropertiesChangedEventArg> changedEvent;
 public:
@@ -83,9 +206,18 @@ public:
         FLOAT,
         BOOL,
         VEC3F,
-        RGBACOLOR
+        RGBACOLOR,
+        DOUBLE,
+        INT64,
+        STRING
     };
-
+private:
+    PropertyValue MakeValue(const string& v, PropertyType type);
+    PropertyTreeNode* LoadYamlSeq(PropertyTreeNode* r, const YAML::Node& n,
+                                  PropertyType elementType);
+    bool LoadPackedSeq(PropertyTreeNode* r, const YAML::Node& n,
+                       PropertyType elementType);
+public:
 
     const YAML::Node* NodeForKeyPath(string key);
 
@@ -104,18 +236,78 @@ public:
 
     void Save();
     void SaveWithComments();
+    /**
+     * Write the type of every typed value as a YAML tag, so types are
+     * known as soon as the file is loaded again.
+     */
+    void SetSaveTypeHints(bool enable) { saveTypeHints = enable; }
 
     PropertyTree();
     PropertyTree(std::string fname);
+    ~PropertyTree();
     PropertyTreeNode* GetRootNode();
+    unsigned int GetGeneration() { return generation; }
+
+    PropertyAtomTable& GetAtomTable() { return atoms; }
+    PropertyAtomTable::Stats GetAtomStats() { return atoms.GetStats(); }
     void Reload(bool skipTS=false);
     void ReloadIfNeeded();
     void Print();
 
     void Handle(Core::ProcessEventArg arg);
+
+    void Subscribe(const string& pattern,
+                   Core::IListener<PropertiesChangedEventArg>& listener);
+    void Unsubscribe(const string& pattern,
+                     Core::IListener<PropertiesChangedEventArg>& listener);
+
+    void SetDispatchBudget(unsigned int usec, unsigned int count=0);
+    void FlushEvents();
+    unsigned int GetPendingEventCount() { return queuedEvents; }
+
+    PropertySnapshot Snapshot();
+    void PublishSnapshot();
+
+    void BeginTransaction();
+    void Commit();
+    bool InTransaction() { return transactionDepth > 0; }
     
     Core::IEvent<PropertiesChangedEventArg>& PropertiesChangedEvent();
 };
+
+/**
+ * Groups a number of sets into one change. Values and versions are
+ * updated by each Set as usual, so direct reads inside the
+ * transaction already see them; what waits for the commit is dirty
+ * propagation to ancestors, events and snapshot publishing, so
+ * listeners and snapshot readers get all of the sets at once.
+ * Transactions may be nested, the outermost one commits.
+ *
+ * @code
+ * {
+ *     PropertyTransaction t(tree);
+ *     cam->Set("position", pos);
+ *     cam->Set("fov", fov);
+ * } // committed here
+ * @endcode
+ */
+class PropertyTransaction {
+private:
+    PropertyTree* tree;
+    PropertyTransaction(const PropertyTransaction&);
+    PropertyTransaction& operator=(const PropertyTransaction&);
+public:
+    PropertyTransaction(PropertyTree* t) : tree(t) {
+        tree->BeginTransaction();
+    }
+    ~PropertyTransaction() {
+        Commit();
+    }
+    void Commit() {
+        if (tree) tree->Commit();
+        tree = NULL;
+    }
+};
 } // NS Utils
 } // NS OpenEngine
 
@@ -8,7 +8,10 @@
 //--------------------------------------------------------------------
 
 #include "PropertyTreeNode.h"
+#include "PropertySnapshot.h"
 #include <Utils/Convert.h>
+#include <cstdlib>
+#include <cstring>
 
 namespace OpenEngine {
 namespace Utils {
@@ -16,137 +19,132 @@ namespace Utils {
 using namespace Math;
 using namespace std;
 
-    // Typing
-
-template <> PropertyTree::PropertyType WhatType<Vector<3,float> >() 
-{ return PropertyTree::VEC3F;}
-template <> PropertyTree::PropertyType WhatType<RGBAColor >() 
-{ return PropertyTree::RGBACOLOR;}
-template <> PropertyTree::PropertyType WhatType<float >() 
-{ return PropertyTree::FLOAT;}
-template <> PropertyTree::PropertyType WhatType<int >() 
-{ return PropertyTree::INT32;}
-template <> PropertyTree::PropertyType WhatType<unsigned int >() 
-{ return PropertyTree::UINT32;}
-template <> PropertyTree::PropertyType WhatType<bool >() 
-{ return PropertyTree::BOOL;}
-
-    // Conversion
-
-template <>
-Vector<3,float> ConvertFromString<Vector<3,float> >(string s) {
-    Vector<3,float> v;
-    istringstream istream(s);
-    istream >> v[0];
-    istream >> v[1];
-    istream >> v[2];
-    return v;
+/**
+ * Vectors and colors are stored as PACKED float nodes. Nodes that
+ * were built as arrays element by element are read and written
+ * through their element nodes, so pointers to those stay valid.
+ */
+template <class V>
+static bool GetTuple(PropertyTreeNode* n, V* def, unsigned int size) {
+    if (n->IsPacked()) {
+        PropertySpan<const float> span = n->GetArray<float>();
+        for (unsigned int i = 0; i < size && i < span.GetSize(); i++)
+            (*def)[i] = span[i];
+        return true;
+    }
+    if (n->kind != PropertyTreeNode::ARRAY)
+        return false;
+    for (unsigned int i = 0; i < size; i++)
+        (*def)[i] = n->GetIdx(i, (*def)[i]);
+    return true;
 }
 
-template <>
-Math::Vector<4,float> ConvertFromString<Math::Vector<4,float> >(string s) {
-    Vector<4,float> v;
-    istringstream istream(s);
-    istream >> v[0];
-    istream >> v[1];
-    istream >> v[2];
-    istream >> v[3];
-    return v;
+template <class V>
+static bool LoadTuple(const PropertyPackedArray& a, unsigned int offset,
+                      unsigned int count, V* def, unsigned int size) {
+    for (unsigned int i = 0; i < size && i < count; i++)
+        (*def)[i] = a.GetElement(offset + i).As<float>();
+    return true;
 }
 
-template <>
-Math::RGBAColor ConvertFromString<Math::RGBAColor >(string s) {
-    RGBAColor v;
-    istringstream istream(s);
-    istream >> v[0];
-    istream >> v[1];
-    istream >> v[2];
-    istream >> v[3];
-    return v;
+template <class V>
+static bool FindTuple(const PropertyTreeNode* n, V* def, unsigned int size) {
+    if (n->IsPacked())
+        return LoadTuple(*n->packed, 0, n->packed->GetSize(), def, size);
+    if (n->kind != PropertyTreeNode::ARRAY)
+        return false;
+    for (unsigned int i = 0; i < size; i++) {
+        const PropertyTreeNode* e = n->FindIdx(i);
+        if (e) e->TryGet(&(*def)[i]);
+    }
+    return true;
 }
 
-
+template <class V>
+static void SetTuple(PropertyTreeNode* n, const V& v, unsigned int size) {
+    if (n->kind == PropertyTreeNode::ARRAY) {
+        for (unsigned int i = 0; i < size; i++)
+            n->GetNodeIdx(i)->Set(v[i]);
+        return;
+    }
+    float data[4];
+    for (unsigned int i = 0; i < size; i++)
+        data[i] = v[i];
+    // Set fires the event
+    n->SetArray(data, size, true);
+}
 
 template <>
 bool ConvertFromSpecialNode<Vector<3,float> >(PropertyTreeNode* n,
                                                          Vector<3,float>* def) {
-    Vector<3,float> v = *def;
-    n->kind = PropertyTreeNode::ARRAY;
-
-    v[0] = n->GetIdx(0,v[0]);
-    v[1] = n->GetIdx(1,v[1]);
-    v[2] = n->GetIdx(2,v[2]);
-    
-    *def = v;
-    return true;
+    return GetTuple(n, def, 3);
 }
 
 template <>
 bool ConvertFromSpecialNode<Vector<4,float> >(PropertyTreeNode* n,
                                                          Vector<4,float>* def) {
-    Vector<4,float> v = *def;
-    n->kind = PropertyTreeNode::ARRAY;
-
-    v[0] = n->GetIdx(0,v[0]);
-    v[1] = n->GetIdx(1,v[1]);
-    v[2] = n->GetIdx(2,v[2]);
-    v[3] = n->GetIdx(3,v[3]);       
-    
-    *def = v;
-    return true;
+    return GetTuple(n, def, 4);
+}
+
+template <>
+bool ConvertFromSpecialNode<RGBAColor >(PropertyTreeNode* n, RGBAColor* def) {
+    return GetTuple(n, def, 4);
 }
 
 
 template <>
-string ConvertToString<Vector<3,float> >(Vector<3,float> v) {
-    ostringstream ostream;
-    ostream << v[0] << " ";
-    ostream << v[1] << " ";
-    ostream << v[2] << " ";
-    return ostream.str();
+bool ConvertFromConstNode<Vector<3,float> >(const PropertyTreeNode* n,
+                                            Vector<3,float>* def) {
+    return FindTuple(n, def, 3);
 }
 
 template <>
-string ConvertToString<Vector<4,float> >(Vector<4,float> v) {
-    ostringstream ostream;
-    ostream << v[0] << " ";
-    ostream << v[1] << " ";
-    ostream << v[2] << " ";
-    ostream << v[3] << " ";
-    return ostream.str();
+bool ConvertFromConstNode<Vector<4,float> >(const PropertyTreeNode* n,
+                                            Vector<4,float>* def) {
+    return FindTuple(n, def, 4);
 }
 
 template <>
-string ConvertToString<RGBAColor >(RGBAColor v) {
-    ostringstream ostream;
-    ostream << v[0] << " ";
-    ostream << v[1] << " ";
-    ostream << v[2] << " ";
-    ostream << v[3] << " ";
-    return ostream.str();
+bool ConvertFromConstNode<RGBAColor >(const PropertyTreeNode* n, RGBAColor* def) {
+    return FindTuple(n, def, 4);
 }
 
+template <>
+bool ConvertFromPacked<Vector<3,float> >(const PropertyPackedArray& a,
+                                         unsigned int offset, unsigned int size,
+                                         Vector<3,float>* def) {
+    return LoadTuple(a, offset, size, def, 3);
+}
 
 template <>
-bool ConvertToSpecial<Vector<3,float> >(PropertyTreeNode* n, Vector<3,float> v) {
-    n->kind = PropertyTreeNode::ARRAY;
+bool ConvertFromPacked<Vector<4,float> >(const PropertyPackedArray& a,
+                                         unsigned int offset, unsigned int size,
+                                         Vector<4,float>* def) {
+    return LoadTuple(a, offset, size, def, 4);
+}
 
-    n->GetNodeIdx(0)->Set(v[0]);
-    n->GetNodeIdx(1)->Set(v[1]);
-    n->GetNodeIdx(2)->Set(v[2]);
+template <>
+bool ConvertFromPacked<RGBAColor >(const PropertyPackedArray& a,
+                                   unsigned int offset, unsigned int size,
+                                   RGBAColor* def) {
+    return LoadTuple(a, offset, size, def, 4);
+}
 
+template <>
+bool ConvertToSpecial<Vector<3,float> >(PropertyTreeNode* n, Vector<3,float> v) {
+    SetTuple(n, v, 3);
     return true;
 }
 
 template <>
 bool ConvertToSpecial<Vector<4,float> >(PropertyTreeNode* n, Vector<4,float> v) {
-    n->kind = PropertyTreeNode::ARRAY;
-
-    n->GetNodeIdx(0)->Set(v[0]);
-    n->GetNodeIdx(1)->Set(v[1]);
-    n->GetNodeIdx(2)->Set(v[2]);
-    n->GetNodeIdx(3)->Set(v[3]);
+    SetTuple(n, v, 4);
+    return true;
+}
 
+template <>
+bool ConvertToSpecial<RGBAColor >(PropertyTreeNode* n, RGBAColor v) {
+    SetTuple(n, v, 4);
     return true;
 }
 
@@ -161,17 +159,29 @@ PropertyTree::PropertyType PropertyTreeNode::GetType() {
 
 
 PropertyTreeNode::~PropertyTreeNode() {
-    for(map<string, PropertyTreeNode*>::iterator itr = subNodes.begin();
+    if (!tree->destroying) {
+        tree->RemoveFromDirtySet(this);
+        if (throttled)
+            tree->RemoveThrottles(this);
+        if (indexed)
+            tree->RemoveIndexes(this);
+    }
+    if (snapshot)
+        tree->snapshots->Retire(snapshot);
+    delete packed;
+    delete extras;
+    ClearRecords();
+    for(PropertyNodeMap::iterator itr = subNodes.begin();
         itr != subNodes.end();
         itr++) {
         PropertyTreeNode *n = itr->second;
-        delete n;
+        tree->DestroyNode(n);
     }
     for (vector<PropertyTreeNode*>::iterator itr = subNodesArray.begin();
          itr != subNodesArray.end();
          itr++) {
         PropertyTreeNode *n = *itr;
-        delete n;
+        tree->DestroyNode(n);
 
     }
 }
@@ -182,18 +192,41 @@ string PropertyTreeNode::ToString(int tabs) {
     if (kind == MAP) {
         ost << "map { " << endl;
 
-        for(map<string, PropertyTreeNode*>::iterator itr = subNodes.begin();
-            itr != subNodes.end();
+        vector<PropertyNodeMap::Entry*> sorted;
+        subNodes.GetSorted(sorted);
+        for(vector<PropertyNodeMap::Entry*>::iterator itr = sorted.begin();
+            itr != sorted.end();
             itr++) {
-            string key = itr->first;
-            PropertyTreeNode* n = itr->second;
+            string key = (*itr)->first->str;
+            PropertyTreeNode* n = (*itr)->second;
 
             ost << key << " = " << n->ToString();
             ost << endl;
         }
         ost << "}";
     } else if (kind == SCALAR) {
-        ost << value;
+        ost << value.ToString();
+    } else if (kind == PACKED) {
+        ost << "packed [";
+        for (unsigned int i = 0; i < packed->GetSize(); i++)
+            ost << " " << packed->GetElement(i).ToString();
+        ost << " ]";
+    } else if (kind == RECORDS) {
+        ost << "records [" << endl;
+        for (unsigned int i = 0; i < records->GetSize(); i++) {
+            ost << i << " = {";
+            for (unsigned int c = 0; c < records->GetColumnCount(); c++) {
+                const PropertyColumn& col = records->GetColumn(c);
+                ost << " " << col.key->str << " = ";
+                if (col.kind == PropertyColumn::TUPLE) {
+                    for (unsigned int j = 0; j < col.width; j++)
+                        ost << col.numbers.GetElement(i * col.width + j).ToString() << " ";
+                } else
+                    ost << col.GetValue(i).ToString();
+            }
+            ost << " }" << endl;
+        }
+        ost << "]";
     } else if (kind == ARRAY) {
         ost << "array [" << endl;
         int i=0;
@@ -213,24 +246,30 @@ string PropertyTreeNode::ToString(int tabs) {
 
 
 void PropertyTreeNode::Refresh(bool recursive) {
-    list<string> clearList;
-    for (map<string,string>::iterator itr = localCache.begin();
-         itr != localCache.end();
-         itr++) {
-        string key = itr->first;
+    if (extras && !extras->localCache.empty()) {
+        map<string,string>& localCache = extras->localCache;
+        list<string> clearList;
+        string nodePath = GetNodePath();
+        for (map<string,string>::iterator itr = localCache.begin();
+             itr != localCache.end();
+             itr++) {
+            string key = itr->first;
 
-        if (tree->HaveKey(nodePath, key)) {
-            clearList.push_back(key);
+            if (tree->HaveKey(nodePath, key)) {
+                clearList.push_back(key);
 
+            }
         }
-    }
-    for (list<string>::iterator itr = clearList.begin();
-         itr != clearList.end();
-         itr++) {
-        localCache.erase(*itr);
+        for (list<string>::iterator itr = clearList.begin();
+             itr != clearList.end();
+             itr++) {
+            localCache.erase(*itr);
+        }
+        if (!tree->dispatching)
+            ReleaseExtras();
     }
     if (recursive) {
-        for (map<string,PropertyTreeNode*>::iterator itr = subNodes.begin();
+        for (PropertyNodeMap::iterator itr = subNodes.begin();
              itr != subNodes.end();
              itr++) {
             PropertyTreeNode* node = itr->second;
@@ -240,88 +279,438 @@ void PropertyTreeNode::Refresh(bool recursive) {
 
 }
 
-PropertyTreeNode* PropertyTreeNode::GetNodePath(string nodePath) {
-    using namespace boost;
-    vector<string> paths;
-    split(paths,nodePath,is_any_of("."));
+PropertyTreeNode* PropertyTreeNode::GetNodePath(const string& keyPath) {
     PropertyTreeNode* node = this;
-    for (vector<string>::iterator itr = paths.begin();
-         itr != paths.end();
-         itr++) {
-        string pathPart = *itr;
-        node = node->GetNode(pathPart);
+    string::size_type start = 0;
+    for (;;) {
+        string::size_type end = keyPath.find('.', start);
+        if (end == string::npos)
+            return node->GetNode(keyPath.data() + start, keyPath.size() - start);
+        node = node->GetNode(keyPath.data() + start, end - start);
+        start = end + 1;
     }
-    return node;
+}
+
+/**
+ * Writes the path from the root to this node, the keys joined by
+ * dots, into buffer. The path is only written if it fits together
+ * with the terminating zero. Returns the length of the path.
+ */
+unsigned int PropertyTreeNode::GetNodePath(char* buffer, unsigned int size) const {
+    unsigned int length = 0;
+    for (const PropertyTreeNode* n = this; n->parent; n = n->parent)
+        length += n->key->str.size() + (n->parent->parent ? 1 : 0);
+    if (length >= size)
+        return length;
+    unsigned int end = length;
+    buffer[end] = '\0';
+    for (const PropertyTreeNode* n = this; n->parent; n = n->parent) {
+        const string& k = n->key->str;
+        end -= k.size();
+        memcpy(buffer + end, k.data(), k.size());
+        if (end)
+            buffer[--end] = '.';
+    }
+    return length;
+}
+
+string PropertyTreeNode::GetNodePath() const {
+    vector<char> buffer(GetNodePath(NULL, 0) + 1);
+    GetNodePath(&buffer[0], buffer.size());
+    return string(&buffer[0], buffer.size() - 1);
 }
 
  PropertyTreeNode* PropertyTreeNode::GetNodeIdx(unsigned int i) {
+     if (kind == RECORDS && i < records->GetSize())
+         return GetRecord(i);
+     LeaveTable();
+     if (kind == PACKED || kind == RECORDS)
+         Unpack();
      kind = PropertyTreeNode::ARRAY;
-     string key = Convert::ToString(i);
-     string p = key;
-     if (nodePath.compare("") != 0)
-         p = nodePath + "." + key;     
      if (i >= subNodesArray.size()) {
-         subNodesArray.push_back(new PropertyTreeNode(tree,this,p));
+         while (i >= subNodesArray.size())
+             AddElement()->SetDirty(PropertiesChangedEventArg::STRUCTURE);
          SetDirty(PropertiesChangedEventArg::STRUCTURE);        
      }
      return subNodesArray[i];
  }
 
+/**
+ * Appends an element node without any events.
+ */
+PropertyTreeNode* PropertyTreeNode::AddElement() {
+    string key = Convert::ToString(subNodesArray.size());
+    PropertyTreeNode* n = tree->CreateNode(this, tree->atoms.Intern(key));
+    subNodesArray.push_back(n);
+    return n;
+}
+
+/**
+ * Makes this a PACKED node, dropping any element and map nodes.
+ * Returns true if the kind changed.
+ */
+bool PropertyTreeNode::Pack() {
+    if (kind == PACKED)
+        return false;
+    LeaveTable();
+    if (kind == RECORDS)
+        Unpack();
+    tree->ClearMap(this);
+    tree->ResizeArray(this, 0);
+    if (!packed)
+        packed = new PropertyPackedArray();
+    kind = PACKED;
+    return true;
+}
+
+/**
+ * Turns a PACKED or RECORDS node into an ARRAY with one element node
+ * per value or record. The values are the same, so nothing is marked
+ * dirty.
+ */
+void PropertyTreeNode::Unpack() {
+    if (kind == RECORDS) {
+        for (unsigned int i = 0; i < records->GetSize(); i++)
+            GetRecord(i);
+        subNodesArray.swap(records->rows);
+        delete records;
+        records = NULL;
+        kind = ARRAY;
+        MarkStale();
+        return;
+    }
+    kind = ARRAY;
+    for (unsigned int i = 0; i < packed->GetSize(); i++) {
+        PropertyTreeNode* n = AddElement();
+        n->value = packed->GetElement(i);
+        n->isSet = true;
+        n->isLoaded = isLoaded;
+    }
+    ClearPacked();
+    MarkStale();
+}
+
+void PropertyTreeNode::ClearPacked() {
+    delete packed;
+    packed = NULL;
+}
+
+/**
+ * The node for record i of a RECORDS node, created with a child per
+ * column the first time it is asked for.
+ */
+PropertyTreeNode* PropertyTreeNode::GetRecord(unsigned int i) {
+    PropertyTreeNode*& r = records->rows[i];
+    if (r)
+        return r;
+    r = tree->CreateNode(this, tree->atoms.Intern(Convert::ToString(i)));
+    r->kind = MAP;
+    r->isLoaded = isLoaded;
+    // snapshots are built from the columns, changes only have to
+    // reach the table
+    r->snapshotStale = false;
+    for (unsigned int c = 0; c < records->GetColumnCount(); c++) {
+        const PropertyAtom* k = records->GetColumn(c).key;
+        PropertyTreeNode* cell = tree->CreateNode(r, k);
+        cell->isLoaded = isLoaded;
+        cell->snapshotStale = false;
+        records->LoadCell(i, c, cell);
+        r->subNodes.Insert(k, cell);
+    }
+    return r;
+}
+
+/**
+ * Writes a changed child of one of the records back to its column.
+ * A value the column cannot hold turns the table into plain nodes.
+ */
+void PropertyTreeNode::StoreCell(PropertyTreeNode* cell) {
+    unsigned int row = strtoul(cell->parent->key->str.c_str(), NULL, 10);
+    int c = records->FindColumn(cell->key);
+    if (!records->StoreCell(row, c, cell))
+        Unpack();
+}
+
+/**
+ * Records and their children can only change in place. Before they
+ * change shape the table they belong to is unpacked.
+ */
+void PropertyTreeNode::LeaveTable() {
+    if (parent && parent->kind == RECORDS)
+        parent->Unpack();
+    else if (parent && parent->parent && parent->parent->kind == RECORDS)
+        parent->parent->Unpack();
+}
 
-PropertyTreeNode* PropertyTreeNode::GetNode(string key) {
+void PropertyTreeNode::ClearRecords() {
+    if (!records)
+        return;
+    for (vector<PropertyTreeNode*>::iterator itr = records->rows.begin();
+         itr != records->rows.end();
+         itr++) {
+        if (*itr)
+            tree->RemoveNode(*itr);
+    }
+    delete records;
+    records = NULL;
+}
+
+
+PropertyTreeNode* PropertyTreeNode::GetNode(const char* key, size_t len) {
+    const PropertyAtom* atom = tree->atoms.Find(key, len);
+    // a hit is all GetNode(atom) would do as well, the node is a map
+    PropertyTreeNode* n = atom ? subNodes.Find(atom) : NULL;
+    if (n) {
+        kind = MAP;
+        return n;
+    }
+    // interning again only counts the new reference in the stats
+    return GetNode(tree->atoms.Intern(key, len));
+}
+
+PropertyTreeNode* PropertyTreeNode::GetNode(const PropertyAtom* key) {
+    if (kind == PACKED || kind == RECORDS)
+        Unpack();
+    PropertyTreeNode* n = subNodes.Find(key);
+    if (!n)
+        LeaveTable();
     kind = PropertyTreeNode::MAP;
-    string p = key;
-    if (nodePath.compare("") != 0)
-        p = nodePath + "." + key;
-    if (!subNodes.count(key)) {
-        subNodes[key] = new PropertyTreeNode(tree,this,p);
+    if (!n) {
+        n = tree->CreateNode(this, key);
+        subNodes.Insert(key, n);
+        // the new node is dirty itself so subscriptions to its path fire
+        n->SetDirty(PropertiesChangedEventArg::STRUCTURE);
         SetDirty(PropertiesChangedEventArg::STRUCTURE);
     }
+    return n;
+}
 
-    return subNodes[key];
+PropertyTreeNode* PropertyTreeNode::FindNode(const char* key, size_t len) const {
+    const PropertyAtom* atom = tree->atoms.Find(key, len);
+    if (!atom)
+        return NULL;
+    return subNodes.Find(atom);
 }
 unsigned int PropertyTreeNode::GetSize() {
+    if (kind == PACKED)
+        return packed->GetSize();
+    if (kind == RECORDS)
+        return records->GetSize();
     return subNodesArray.size();
 }
 
 
-bool PropertyTreeNode::HaveNode(string kp) {
-    return subNodes.count(kp);
+bool PropertyTreeNode::HaveNode(const string& kp) {
+    return FindNode(kp.data(), kp.size()) != NULL;
 }
-bool PropertyTreeNode::HaveNodePath(string kp) {
-    using namespace boost;
-    vector<string> paths;
-    split(paths, kp, is_any_of("."));
-    PropertyTreeNode* node = this;
-    for (vector<string>::iterator itr = paths.begin();
-         itr != paths.end();
-         itr++) {
-        string pathPart = *itr;
-        if (node->HaveNode(pathPart))
-            node = node->GetNode(pathPart);
-        else 
+bool PropertyTreeNode::HaveNodePath(const string& kp) {
+    return Find(kp) != NULL;
+}
+
+const PropertyTreeNode* PropertyTreeNode::Find(const string& keyPath) const {
+    Slot s(this);
+    if (!FindSlot(keyPath, s) || s.at != Slot::NODE)
+        return NULL;
+    return s.node;
+}
+
+bool PropertyTreeNode::FindSlot(const string& keyPath, Slot& s) const {
+    string::size_type start = 0;
+    for (;;) {
+        string::size_type end = keyPath.find('.', start);
+        if (end == string::npos)
+            return Step(s, keyPath.data() + start, keyPath.size() - start);
+        if (!Step(s, keyPath.data() + start, end - start))
             return false;
+        start = end + 1;
+    }
+}
+
+/**
+ * A number is an array position if there is an array to index,
+ * otherwise it is a key.
+ */
+bool PropertyTreeNode::Step(Slot& s, const char* key, size_t len) {
+    bool indexable = (s.at == Slot::NODE && s.node->IsArray()) ||
+        (s.at == Slot::NUMBERS && s.width > 1);
+    if (!indexable || !len)
+        return StepKey(s, key, len);
+    unsigned int i = 0;
+    for (size_t c = 0; c < len; c++) {
+        if (key[c] < '0' || key[c] > '9')
+            return StepKey(s, key, len);
+        i = i * 10 + (key[c] - '0');
     }
+    return StepIdx(s, i);
+}
+
+bool PropertyTreeNode::StepIdx(Slot& s, unsigned int i) {
+    if (s.at == Slot::NUMBERS) {
+        if (i >= s.width)
+            return false;
+        s.offset += i;
+        s.width = 1;
+        return true;
+    }
+    if (s.at != Slot::NODE)
+        return false;
+    const PropertyTreeNode* n = s.node;
+    if (n->kind == PACKED) {
+        if (i >= n->packed->GetSize())
+            return false;
+        s.at = Slot::NUMBERS;
+        s.numbers = n->packed;
+        s.offset = i;
+        s.width = 1;
+        return true;
+    }
+    if (n->kind == RECORDS) {
+        if (i >= n->records->GetSize())
+            return false;
+        if (n->records->rows[i])
+            s.node = n->records->rows[i];
+        else {
+            s.at = Slot::ROW;
+            s.row = i;
+        }
+        return true;
+    }
+    s.node = n->FindIdx(i);
+    return s.node != NULL;
+}
+
+bool PropertyTreeNode::StepKey(Slot& s, const char* key, size_t len) {
+    if (s.at == Slot::NODE) {
+        s.node = s.node->FindNode(key, len);
+        return s.node != NULL;
+    }
+    if (s.at != Slot::ROW)
+        return false;
+    const PropertyRecordTable& table = *s.node->records;
+    int c = table.FindColumn(s.node->tree->atoms.Find(key, len));
+    if (c < 0)
+        return false;
+    const PropertyColumn& col = table.GetColumn(c);
+    if (col.kind == PropertyColumn::VALUE) {
+        s.at = Slot::VALUE;
+        s.value = &col.values[s.row];
+        return true;
+    }
+    s.at = Slot::NUMBERS;
+    s.numbers = &col.numbers;
+    s.offset = s.row * col.width;
+    s.width = col.width;
     return true;
 }
 
 
+/**
+ * Merges the flags into this node and its ancestors. Inside a
+ * transaction the ancestors are left for the commit.
+ */
 void PropertyTreeNode::SetDirty(PropertiesChangedEventArg::ChangeFlag f) {
-    tree->AddToDirtySet(this, f);
-    if (parent)
-        parent->SetDirty(PropertiesChangedEventArg::ChangeFlag(f  |
-                                                               
- PropertiesChangedEventArg::IS_RECURSIVE));
+    if ((f & PropertiesChangedEventArg::VALUE) && parent && parent->parent &&
+        parent->parent->kind == RECORDS)
+        parent->parent->StoreCell(this);
+    MarkStale();
+    tree->dirtyCount++;
+    unsigned int v = tree->NextVersion();
+    if (!tree->indexes.empty())
+        tree->UpdateIndexes(this, f, v);
+    version = v;
+    // ancestors of a node with the current version have it as well
+    for (PropertyTreeNode* n = this; n && n->subtreeVersion != v; n = n->parent)
+        n->subtreeVersion = v;
+    if (!dirtyFlags)
+        tree->AddToDirtySet(this);
+    dirtyFlags |= f | SELF_CHANGED;
+    pendingFlags |= f;
+    if (!tree->transactionDepth)
+        PropagateDirty();
+}
+
+/**
+ * Pushes the pending flags to the ancestors. An ancestor that already
+ * carries them has had them pushed up to the root, so the walk stops
+ * there.
+ */
+void PropertyTreeNode::PropagateDirty() {
+    unsigned int rf = pendingFlags | PropertiesChangedEventArg::IS_RECURSIVE;
+    pendingFlags = 0;
+    for (PropertyTreeNode* n = parent; n && (n->dirtyFlags & rf) != rf; n = n->parent) {
+        if (!n->dirtyFlags)
+            tree->AddToDirtySet(n);
+        n->dirtyFlags |= rf;
+    }
+}
+bool PropertyTreeNode::IsHeld() const {
+    return refs || (extras && (extras->changedEvent.Size() ||
+                               extras->batchEvent.Size()));
+}
+
+bool PropertyTreeNode::IsSubtreeHeld() const {
+    if (IsHeld())
+        return true;
+    for (PropertyNodeMap::const_iterator itr = subNodes.begin();
+         itr != subNodes.end();
+         itr++) {
+        if (itr->second->IsSubtreeHeld())
+            return true;
+    }
+    for (unsigned int i = 0; i < subNodesArray.size(); i++) {
+        if (subNodesArray[i]->IsSubtreeHeld())
+            return true;
+    }
+    if (records) {
+        for (unsigned int i = 0; i < records->rows.size(); i++) {
+            if (records->rows[i] && records->rows[i]->IsSubtreeHeld())
+                return true;
+        }
+    }
+    return false;
+}
 
+/**
+ * Marks a subtree that has been taken out of the tree and tells the
+ * nodes that are held or listened to.
+ */
+void PropertyTreeNode::MarkRemoved() {
+    removed = true;
+    if (IsHeld())
+        SetDirty(PropertiesChangedEventArg::STRUCTURE);
+    for (PropertyNodeMap::iterator itr = subNodes.begin();
+         itr != subNodes.end();
+         itr++)
+        itr->second->MarkRemoved();
+    for (unsigned int i = 0; i < subNodesArray.size(); i++)
+        subNodesArray[i]->MarkRemoved();
+    if (records) {
+        for (unsigned int i = 0; i < records->rows.size(); i++) {
+            if (records->rows[i])
+                records->rows[i]->MarkRemoved();
+        }
+    }
 }
+
+void PropertyTreeNode::MarkStale() {
+    for (PropertyTreeNode* n = this; n && !n->snapshotStale; n = n->parent)
+        n->snapshotStale = true;
+}
+
 PropertyTreeNode* PropertyTreeNode::GetParent() {
     return parent;
 }
 
 void PropertyTreeNode::SetValue(string v) {
     isSet = true;
-    if (value.compare(v) != 0) {
-        value = v;
+    // keep values that have already been read or have a type hint in
+    // their native form
+    PropertyTree::PropertyType native = value.GetType();
+    if (native == PropertyTree::STRING || native == PropertyTree::UNKNOWN)
+        native = type;
+    PropertyValue newValue = tree->MakeValue(v, native);
+    if (newValue != value) {
+        value = newValue;
         SetDirty(PropertiesChangedEventArg::VALUE);
     }
 }
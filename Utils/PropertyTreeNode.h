@@ -12,6 +12,11 @@
 #define _OE_PROPERTY_TREE_NODE2_H_
 
 #include "PropertyTree.h"
+#include "PropertyValue.h"
+#include "PropertyNodeMap.h"
+#include "PropertyPackedArray.h"
+#include "PropertyRecordTable.h"
+#include "PropertyIndex.h"
 #include <string>
 #include <map>
 #include <sstream>
@@ -27,39 +32,10 @@ namespace OpenEngine {
 namespace Utils {
 
 class PropertyTreeNode;
+class PropertySnapshotNode;
 class PropertiesChangedEventArg;
 
 using namespace std;
-    // Typing
-
-    template <class T>
-    PropertyTree::PropertyType WhatType() {
-        return PropertyTree::UNKNOWN;
-    }
-
-    template <> PropertyTree::PropertyType WhatType<Math::Vector<3,float> >();
-    template <> PropertyTree::PropertyType WhatType<Math::RGBAColor >();
-    template <> PropertyTree::PropertyType WhatType<float >();
-    template <> PropertyTree::PropertyType WhatType<int >();
-    template <> PropertyTree::PropertyType WhatType<unsigned int >();
-    template <> PropertyTree::PropertyType WhatType<bool >();
-
-    // String conversion
-
-    template<class T>
-    string ConvertToString(T val) {
-        ostringstream ostream;
-        ostream << val;
-        return ostream.str();
-    }
-
-    template <> 
-    string ConvertToString<Math::Vector<3,float> >(Math::Vector<3,float>);
-    template <> 
-    string ConvertToString<Math::Vector<4,float> >(Math::Vector<4,float>);
-    template <>
-    string ConvertToString<Math::RGBAColor >(Math::RGBAColor);
-
     template <class T>
     bool ConvertToSpecial(PropertyTreeNode* n, T val) {
         return false;
@@ -71,20 +47,11 @@ using namespace std;
     template <>
     bool ConvertToSpecial<Math::Vector<4,float> >(PropertyTreeNode* n,
                                                   Math::Vector<4,float> v);
+    template <>
+    bool ConvertToSpecial<Math::RGBAColor >(PropertyTreeNode* n,
+                                            Math::RGBAColor v);
 
 
-    template <class T>
-    T ConvertFromString(string s) {
-        istringstream istream(s);
-        T val;
-        istream >> val;
-        return val;
-    }
-
-    template <> Math::Vector<3,float> ConvertFromString<Math::Vector<3,float> >(string s);
-    template <> Math::Vector<4,float> ConvertFromString<Math::Vector<4,float> >(string s);
-    template <> Math::RGBAColor ConvertFromString<Math::RGBAColor >(string s);
-
     // special
 
     template <class T>
@@ -100,6 +67,60 @@ using namespace std;
     bool ConvertFromSpecialNode<Math::Vector<4,float> >
     (PropertyTreeNode* n, Math::Vector<4,float>* def);
 
+    template <>
+    bool ConvertFromSpecialNode<Math::RGBAColor >
+    (PropertyTreeNode* n, Math::RGBAColor* def);
+
+    template <class T>
+    bool ConvertFromConstNode(const PropertyTreeNode* n, T* def) {
+        return false;
+    }
+
+    template <>
+    bool ConvertFromConstNode<Math::Vector<3,float> >
+    (const PropertyTreeNode* n, Math::Vector<3,float>* def);
+
+    template <>
+    bool ConvertFromConstNode<Math::Vector<4,float> >
+    (const PropertyTreeNode* n, Math::Vector<4,float>* def);
+
+    template <>
+    bool ConvertFromConstNode<Math::RGBAColor >
+    (const PropertyTreeNode* n, Math::RGBAColor* def);
+
+    // size numbers from offset in a packed array
+    template <class T>
+    bool ConvertFromPacked(const PropertyPackedArray& a, unsigned int offset,
+                           unsigned int size, T* def) {
+        return false;
+    }
+
+    template <>
+    bool ConvertFromPacked<Math::Vector<3,float> >
+    (const PropertyPackedArray& a, unsigned int offset, unsigned int size,
+     Math::Vector<3,float>* def);
+
+    template <>
+    bool ConvertFromPacked<Math::Vector<4,float> >
+    (const PropertyPackedArray& a, unsigned int offset, unsigned int size,
+     Math::Vector<4,float>* def);
+
+    template <>
+    bool ConvertFromPacked<Math::RGBAColor >
+    (const PropertyPackedArray& a, unsigned int offset, unsigned int size,
+     Math::RGBAColor* def);
+
+
+/**
+ * Per node state that only few nodes use. It is allocated the first
+ * time a listener attaches or the local cache is touched, and freed
+ * again after dispatch or Refresh once it holds nothing.
+ */
+struct PropertyNodeExtras {
+    Core::Event<PropertiesChangedEventArg> changedEvent;
+    Core::Event<PropertiesChangedBatchEventArg> batchEvent;
+    map<string,string> localCache;
+};
 
 /**
  * Tree structure used for configurations
@@ -109,35 +130,164 @@ using namespace std;
 class PropertyTreeNode {
 protected:
     friend class PropertyTree;
+    friend class PropertySnapshots;
+    friend class PropertyRecordTable;
 
 private:
-    Core::Event<PropertiesChangedEventArg> changedEvent;
+    PropertyNodeExtras* GetExtras() {
+        if (!extras)
+            extras = new PropertyNodeExtras();
+        return extras;
+    }
+    // only where no event of this node can be notifying
+    void ReleaseExtras() {
+        if (extras && !extras->changedEvent.Size() &&
+            !extras->batchEvent.Size() && extras->localCache.empty()) {
+            delete extras;
+            extras = NULL;
+        }
+    }
     void SetDirty(PropertiesChangedEventArg::ChangeFlag);
+    void PropagateDirty();
+    void MarkStale();
+    bool IsHeld() const;
+    bool IsSubtreeHeld() const;
+    void MarkRemoved();
+    /**
+     * The first type a node gets, from a read or a type hint, is not
+     * a change. Returns true only when a known type is replaced.
+     */
+    bool UpdateType(PropertyTree::PropertyType t) {
+        PropertyTree::PropertyType oldType = type;
+        type = t;
+        return oldType != t && oldType != PropertyTree::UNKNOWN;
+    }
+    PropertyTreeNode* GetNode(const char* key, size_t len);
+    PropertyTreeNode* FindNode(const char* key, size_t len) const;
+
+    /**
+     * Where a read only lookup has got to. Elements of PACKED nodes
+     * and records that have no nodes are read in place from the
+     * packed numbers and the columns.
+     */
+    struct Slot {
+        enum At {NODE, ROW, NUMBERS, VALUE};
+        At at;
+        // the node, or the RECORDS node of a row
+        const PropertyTreeNode* node;
+        unsigned int row;
+        const PropertyPackedArray* numbers;
+        unsigned int offset;
+        unsigned int width;
+        const PropertyValue* value;
+        Slot(const PropertyTreeNode* n)
+            : at(NODE), node(n), row(0), numbers(NULL)
+            , offset(0), width(0), value(NULL) {}
+    };
+    static bool StepIdx(Slot& s, unsigned int i);
+    static bool StepKey(Slot& s, const char* key, size_t len);
+    static bool Step(Slot& s, const char* key, size_t len);
+    bool FindSlot(const string& keyPath, Slot& s) const;
+
+    template <class T>
+    static bool LoadSlot(const Slot& s, T* val) {
+        switch (s.at) {
+        case Slot::NODE:
+            return s.node->TryGet(val);
+        case Slot::VALUE:
+            PropertyValueTraits<T>::Load(*s.value, val);
+            return true;
+        case Slot::NUMBERS:
+            if (ConvertFromPacked<T>(*s.numbers, s.offset, s.width, val))
+                return true;
+            if (s.width != 1)
+                return false;
+            PropertyValueTraits<T>::Load(s.numbers->GetElement(s.offset), val);
+            return true;
+        default:
+            return false;
+        }
+    }
+    PropertyTreeNode* AddElement();
+    bool Pack();
+    void Unpack();
+    void ClearPacked();
+    PropertyTreeNode* GetRecord(unsigned int i);
+    void StoreCell(PropertyTreeNode* cell);
+    void LeaveTable();
+    void ClearRecords();
     PropertyTreeNode* parent;
+    const PropertyAtom* key;
     PropertyTree::PropertyType type;
     bool isRead;
+    bool isLoaded;
+    bool throttled;
+    bool indexed;
+    bool removed;
+    unsigned int refs;
+    const PropertySnapshotNode* snapshot;
+    bool snapshotStale;
+    unsigned int version;
+    unsigned int subtreeVersion;
+    unsigned int dirtyFlags;
+    unsigned int pendingFlags;
+    // dirtyFlags bit of a node that changed itself, not only below
+    static const unsigned int SELF_CHANGED = 1 << 4;
+    int dirtyIndex;
+    int dispatchIndex;
+    PropertyTreeNode* firstDirtyChild;
+    PropertyTreeNode* nextDirtySibling;
+    PropertyNodeExtras* extras;
 public:
     PropertyTree* tree;
-    string nodePath;
-    string value;
+    PropertyValue value;
 
     bool isSet;
 
-    map<string,string> localCache;
-    map<string, PropertyTreeNode*> subNodes;
+    PropertyNodeMap subNodes;
     vector<PropertyTreeNode*> subNodesArray;
+    PropertyPackedArray* packed;
+    PropertyRecordTable* records;
 public:
-    enum Kind {SCALAR,MAP,ARRAY};
+    /**
+     * PACKED nodes hold a numeric sequence in packed instead of
+     * element nodes. They are unpacked into an ARRAY the first time
+     * an element node is asked for.
+     *
+     * RECORDS nodes hold a sequence of maps with the same keys in
+     * the columns of records. Record nodes are created on demand and
+     * only their values can change, adding keys or elements turns
+     * the table into an ARRAY.
+     */
+    enum Kind {SCALAR,MAP,ARRAY,PACKED,RECORDS};
 
     Kind kind;
 
-    PropertyTreeNode(PropertyTree* t, PropertyTreeNode* parent, string p)
+    PropertyTreeNode(PropertyTree* t, PropertyTreeNode* parent, const PropertyAtom* key)
         :  parent(parent)
+        , key(key)
         , type(PropertyTree::UNKNOWN)
         , isRead(false)
+        , isLoaded(false)
+        , throttled(false)
+        , indexed(false)
+        , removed(false)
+        , refs(0)
+        , snapshot(NULL)
+        , snapshotStale(true)
+        , version(0)
+        , subtreeVersion(0)
+        , dirtyFlags(0)
+        , pendingFlags(0)
+        , dirtyIndex(-1)
+        , dispatchIndex(-1)
+        , firstDirtyChild(NULL)
+        , nextDirtySibling(NULL)
+        , extras(NULL)
         , tree(t)
-        , nodePath(p)
         , isSet(false)
+        , packed(NULL)
+        , records(NULL)
         , kind(SCALAR)
     {
     }
@@ -155,18 +305,43 @@ public:
         return isRead;
     }
 
-    bool IsArray() {
-        return (kind == ARRAY);
+    /**
+     * A node that is held, or has listeners, is not freed when a
+     * reload or a change of its parent takes it out of the tree. It
+     * is marked removed instead, its listeners get a STRUCTURE event
+     * and the tree frees it on a later Handle once it is neither held
+     * nor listened to. Binders hold the node they are bound to.
+     */
+    void Retain() { refs++; }
+    void Release() { refs--; }
+    bool IsRemoved() const { return removed; }
+
+    bool IsArray() const {
+        return (kind == ARRAY || kind == PACKED || kind == RECORDS);
     }
-    bool IsMap() {
-        return (kind == MAP);
+    bool IsPacked() const {
+        return (kind == PACKED);
     }
-    string GetNodePath() {
-        return nodePath;
+    bool IsRecords() const {
+        return (kind == RECORDS);
+    }
+    bool IsMap() const {
+        return (kind == MAP);
     }
+    /**
+     * The path of the node is built from the keys up to the root on
+     * every call, nodes only keep their own key.
+     */
+    string GetNodePath() const;
+    unsigned int GetNodePath(char* buffer, unsigned int size) const;
 
     template <class T>
     T GetIdx(int i, T def) {
+        if (kind == PACKED && unsigned(i) < packed->GetSize()) {
+            isRead = true;
+            PropertyValueTraits<T>::Load(packed->GetElement(i), &def);
+            return def;
+        }
         PropertyTreeNode* node = GetNodeIdx(i);
         return node->Get(def);
     }
@@ -186,17 +361,13 @@ public:
     template <class T>
     T Get(T def) {
         isRead = true;
-        PropertyTree::PropertyType oldType = type;
-        type = WhatType<T>();
-
-        if (oldType != type) {
+        if (UpdateType(WhatType<T>()))
             SetDirty(PropertiesChangedEventArg::TYPE);
-        }
         
         T val = def;
         if (!ConvertFromSpecialNode<T>(this, &val)) {
             if (isSet)
-                val = ConvertFromString<T>(value);
+                value.Load(&val);
             else {
                 Set(val,true);
             }
@@ -208,38 +379,214 @@ public:
 
     template <class T>
     void Set(T val, bool skipEvent=false) {
-        PropertyTree::PropertyType oldType = type;
-        type = WhatType<T>();
+        bool typeChanged = UpdateType(WhatType<T>());
 
         if (!ConvertToSpecial<T>(this, val)) {            
             isSet = !skipEvent;
-            value = ConvertToString(val);
+            value.Store(val);
         }
         
         isSet = true;
 
-        if (skipEvent)
+        if (skipEvent) {
+            MarkStale();
             return;
+        }
         PropertiesChangedEventArg::ChangeFlag flag = PropertiesChangedEventArg::VALUE;
-        if (oldType != type)
+        if (typeChanged)
             flag = PropertiesChangedEventArg::ChangeFlag(flag |
                                                          PropertiesChangedEventArg::TYPE);
 
         SetDirty(flag);
     }
 
+    /**
+     * The elements of a PACKED node. The span is valid until the node
+     * is changed. Int elements are turned into floats when read as
+     * floats, any other mismatch or a node that is not packed gives
+     * an empty span.
+     */
+    template <class E>
+    PropertySpan<const E> GetArray() {
+        isRead = true;
+        PropertySpan<const E> span;
+        if (kind != PACKED)
+            return span;
+        if (packed->GetElementType() == PropertyTree::INT32)
+            packed->ConvertTo(WhatType<E>());
+        packed->Get(span);
+        return span;
+    }
+
+    /**
+     * The values of key for every record of a RECORDS node, width
+     * numbers per record for keys holding number sequences. The same
+     * rules as for GetArray apply, keys that are not numbers give an
+     * empty span.
+     */
+    template <class E>
+    PropertySpan<const E> GetColumn(const string& key) {
+        isRead = true;
+        PropertySpan<const E> span;
+        if (kind != RECORDS)
+            return span;
+        int c = records->FindColumn(tree->atoms.Find(key));
+        if (c < 0 || records->GetColumn(c).kind == PropertyColumn::VALUE)
+            return span;
+        PropertyColumn& column = records->GetColumn(c);
+        if (column.numbers.GetElementType() == PropertyTree::INT32)
+            column.ConvertTo(WhatType<E>());
+        column.numbers.Get(span);
+        return span;
+    }
+
+    /**
+     * Replaces the node with a PACKED node holding a copy of data.
+     * Only float and int elements are supported.
+     */
+    template <class E>
+    void SetArray(const E* data, unsigned int size, bool skipEvent=false) {
+        if (kind == PACKED && packed->Equals(data, size)) {
+            isSet = true;
+            return;
+        }
+        bool restructured = Pack();
+        packed->Set(data, size);
+        isSet = true;
+        if (skipEvent) {
+            MarkStale();
+            return;
+        }
+        PropertiesChangedEventArg::ChangeFlag flag = PropertiesChangedEventArg::VALUE;
+        if (restructured)
+            flag = PropertiesChangedEventArg::ChangeFlag(flag |
+                                                         PropertiesChangedEventArg::STRUCTURE);
+        SetDirty(flag);
+    }
+
     unsigned int GetSize();
 
-    PropertyTreeNode* GetNodePath(string nodePath);
+    PropertyTreeNode* GetNodePath(const string& keyPath);
 
     PropertyTreeNode* GetNodeIdx(unsigned int i);
-    PropertyTreeNode* GetNode(string key);
+    PropertyTreeNode* GetNode(const string& key) {
+        return GetNode(key.data(), key.size());
+    }
+    PropertyTreeNode* GetNode(const PropertyAtom* key);
+
+    bool HaveNode(const string& kp);
+    bool HaveNodePath(const string& kp);
+
+    /**
+     * Versions for polling. The version changes whenever this node is
+     * changed, the subtree version also when anything below it is.
+     * Versions only grow and are never 0 after a change.
+     */
+    unsigned int GetVersion() const {
+        tree->versionObserved = true;
+        return version;
+    }
+    unsigned int GetSubtreeVersion() const {
+        tree->versionObserved = true;
+        return subtreeVersion;
+    }
+
+    /**
+     * Reads the value only if the node or anything below it changed
+     * since lastVersion, which is then updated. A lastVersion of 0
+     * reads any node that has been created or set.
+     */
+    template <class T>
+    bool GetIfChanged(unsigned int& lastVersion, T& val) {
+        if (subtreeVersion == lastVersion)
+            return false;
+        lastVersion = GetSubtreeVersion();
+        val = Get(val);
+        return true;
+    }
+
+    // Read only lookups. These never create nodes or mark anything
+    // dirty, a missing node gives NULL, false or the default. Numbers
+    // in a path are array positions. The elements of PACKED nodes and
+    // records without nodes are not nodes, Find and FindIdx give NULL
+    // for them but TryGet, TryGetIdx and GetOr read them.
+
+    const PropertyTreeNode* Find(const string& keyPath) const;
+    const PropertyTreeNode* FindIdx(unsigned int i) const {
+        if (kind == RECORDS)
+            return i < records->GetSize() ? records->rows[i] : NULL;
+        if (i >= subNodesArray.size())
+            return NULL;
+        return subNodesArray[i];
+    }
+
+    template <class T>
+    bool TryGet(T* val) const {
+        if (ConvertFromConstNode<T>(this, val))
+            return true;
+        if (!isSet)
+            return false;
+        PropertyValueTraits<T>::Load(value, val);
+        return true;
+    }
+
+    template <class T>
+    bool TryGet(const string& keyPath, T* val) const {
+        Slot s(this);
+        return FindSlot(keyPath, s) && LoadSlot(s, val);
+    }
 
-    bool HaveNode(string kp);
-    bool HaveNodePath(string kp);
+    template <class T>
+    bool TryGetIdx(unsigned int i, T* val) const {
+        Slot s(this);
+        return StepIdx(s, i) && LoadSlot(s, val);
+    }
+
+    template <class T>
+    T GetOr(const string& keyPath, T def) const {
+        TryGet(keyPath, &def);
+        return def;
+    }
 
     Core::IEvent<PropertiesChangedEventArg>& PropertiesChangedEvent() {
-        return changedEvent;
+        return GetExtras()->changedEvent;
+    }
+    /**
+     * Attaches a listener that is notified at most once per interval
+     * (in microseconds) and once per number of frames, with the flags
+     * of all changes since the last notification merged.
+     */
+    void AttachThrottled(Core::IListener<PropertiesChangedEventArg>& listener,
+                         unsigned int interval, unsigned int frames=0) {
+        tree->AddThrottle(this, listener, interval, frames);
+    }
+    void DetachThrottled(Core::IListener<PropertiesChangedEventArg>& listener) {
+        tree->RemoveThrottles(this, &listener);
+    }
+    /**
+     * Index over key in the records of this array, created by the
+     * first call for that key and kept until the node is destroyed
+     * or the index is dropped. See PropertyIndex.
+     */
+    PropertyIndex* CreateIndex(const string& key) {
+        return tree->AddIndex(this, key);
+    }
+    void DropIndex(const string& key) {
+        const PropertyAtom* atom = tree->atoms.Find(key);
+        if (atom)
+            tree->RemoveIndexes(this, atom);
+    }
+
+    /**
+     * Fired once per Handle tick with every change in the subtree of
+     * this node, after the per node events.
+     */
+    Core::IEvent<PropertiesChangedBatchEventArg>& PropertiesChangedBatchEvent() {
+        return GetExtras()->batchEvent;
+    }
+
+    map<string,string>& LocalCache() {
+        return GetExtras()->localCache;
     }
 
     string ToString(int tabs=0);
@@ -0,0 +1,215 @@
+//
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "PropertyValue.h"
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace Math;
+using namespace std;
+
+    // Typing
+
+template <> PropertyTree::PropertyType WhatType<Vector<3,float> >() 
+{ return PropertyTree::VEC3F;}
+template <> PropertyTree::PropertyType WhatType<RGBAColor >() 
+{ return PropertyTree::RGBACOLOR;}
+template <> PropertyTree::PropertyType WhatType<float >() 
+{ return PropertyTree::FLOAT;}
+template <> PropertyTree::PropertyType WhatType<double >() 
+{ return PropertyTree::DOUBLE;}
+template <> PropertyTree::PropertyType WhatType<int >() 
+{ return PropertyTree::INT32;}
+template <> PropertyTree::PropertyType WhatType<unsigned int >() 
+{ return PropertyTree::UINT32;}
+template <> PropertyTree::PropertyType WhatType<long long >() 
+{ return PropertyTree::INT64;}
+template <> PropertyTree::PropertyType WhatType<bool >() 
+{ return PropertyTree::BOOL;}
+template <> PropertyTree::PropertyType WhatType<string >() 
+{ return PropertyTree::STRING;}
+
+static const char* typeNames[] = {
+    "", "int", "uint", "float", "bool", "vec3f", "rgba", "double", "int64", "str"
+};
+
+const char* TypeToName(PropertyTree::PropertyType t) {
+    return typeNames[t];
+}
+
+/**
+ * Accepts verbatim tags (!<float>), local tags (!float) and the
+ * standard YAML ones (!!float). Unknown names give UNKNOWN.
+ */
+PropertyTree::PropertyType TypeFromName(const string& name) {
+    static const string core = "tag:yaml.org,2002:";
+    string::size_type start = 0;
+    if (name.compare(0, core.size(), core) == 0)
+        start = core.size();
+    else
+        while (start < name.size() && name[start] == '!')
+            start++;
+    for (unsigned int i = 1; i <= PropertyTree::STRING; i++)
+        if (name.compare(start, string::npos, typeNames[i]) == 0)
+            return PropertyTree::PropertyType(i);
+    return PropertyTree::UNKNOWN;
+}
+
+    // Conversion
+
+template <>
+Vector<3,float> ConvertFromString<Vector<3,float> >(string s) {
+    Vector<3,float> v;
+    istringstream istream(s);
+    istream >> v[0];
+    istream >> v[1];
+    istream >> v[2];
+    return v;
+}
+
+template <>
+Math::Vector<4,float> ConvertFromString<Math::Vector<4,float> >(string s) {
+    Vector<4,float> v;
+    istringstream istream(s);
+    istream >> v[0];
+    istream >> v[1];
+    istream >> v[2];
+    istream >> v[3];
+    return v;
+}
+
+template <>
+Math::RGBAColor ConvertFromString<Math::RGBAColor >(string s) {
+    RGBAColor v;
+    istringstream istream(s);
+    istream >> v[0];
+    istream >> v[1];
+    istream >> v[2];
+    istream >> v[3];
+    return v;
+}
+
+template <>
+string ConvertToString<Vector<3,float> >(Vector<3,float> v) {
+    ostringstream ostream;
+    ostream << v[0] << " ";
+    ostream << v[1] << " ";
+    ostream << v[2] << " ";
+    return ostream.str();
+}
+
+template <>
+string ConvertToString<Vector<4,float> >(Vector<4,float> v) {
+    ostringstream ostream;
+    ostream << v[0] << " ";
+    ostream << v[1] << " ";
+    ostream << v[2] << " ";
+    ostream << v[3] << " ";
+    return ostream.str();
+}
+
+template <>
+string ConvertToString<RGBAColor >(RGBAColor v) {
+    ostringstream ostream;
+    ostream << v[0] << " ";
+    ostream << v[1] << " ";
+    ostream << v[2] << " ";
+    ostream << v[3] << " ";
+    return ostream.str();
+}
+
+    // Value
+
+bool PropertyValue::ConvertTo(PropertyTree::PropertyType t) {
+    if (type != PropertyTree::STRING)
+        return type == t;
+    switch (t) {
+    case PropertyTree::INT32:  return Parse<int>();
+    case PropertyTree::UINT32: return Parse<unsigned int>();
+    case PropertyTree::FLOAT:  return Parse<float>();
+    case PropertyTree::DOUBLE: return Parse<double>();
+    case PropertyTree::INT64:  return Parse<long long>();
+    case PropertyTree::BOOL:   return Parse<bool>();
+    case PropertyTree::STRING: return true;
+    default: return false;
+    }
+}
+
+/**
+ * The shortest text that reads back as the same float or double,
+ * trying from digits up to maxDigits significant digits.
+ */
+template <class R>
+static string ConvertToString(R val, int digits, int maxDigits) {
+    for (;; digits++) {
+        ostringstream ostream;
+        ostream.precision(digits);
+        ostream << val;
+        if (digits >= maxDigits)
+            return ostream.str();
+        istringstream istream(ostream.str());
+        R back;
+        if (istream >> back && back == val)
+            return ostream.str();
+    }
+}
+
+string PropertyValue::ToString() const {
+    if (source)
+        return source->str;
+    switch (type) {
+    case PropertyTree::INT32:  return ConvertToString(data.i);
+    case PropertyTree::UINT32: return ConvertToString(data.u);
+    case PropertyTree::FLOAT:  return ConvertToString(data.f, 6, 9);
+    case PropertyTree::DOUBLE: return ConvertToString(data.d, 15, 17);
+    case PropertyTree::INT64:  return ConvertToString(data.l);
+    case PropertyTree::BOOL:   return ConvertToString(data.b);
+    case PropertyTree::STRING: return data.text->str;
+    default: return "";
+    }
+}
+
+/**
+ * Atoms of another table, such as the scratch tree a load was built
+ * in, must not outlive it. Own atoms stay as they are.
+ */
+void PropertyValue::Intern(PropertyAtomTable& table) {
+    const PropertyAtom* text = GetText();
+    if (!text || !text->table || text->table == &table)
+        return;
+    const PropertyAtom* a = PropertyAtom::Retain(table.InternValue(text->str));
+    if (type == PropertyTree::STRING) {
+        PropertyAtom::Release(data.text);
+        data.text = a;
+    } else {
+        PropertyAtom::Release(source);
+        source = a;
+    }
+}
+
+bool PropertyValue::operator==(const PropertyValue& other) const {
+    if (type != other.type)
+        return false;
+    switch (type) {
+    case PropertyTree::INT32:  return data.i == other.data.i;
+    case PropertyTree::UINT32: return data.u == other.data.u;
+    case PropertyTree::FLOAT:  return data.f == other.data.f;
+    case PropertyTree::DOUBLE: return data.d == other.data.d;
+    case PropertyTree::INT64:  return data.l == other.data.l;
+    case PropertyTree::BOOL:   return data.b == other.data.b;
+    case PropertyTree::STRING: 
+        return data.text == other.data.text
+            || data.text->str == other.data.text->str;
+    default: return true;
+    }
+}
+
+} // NS Utils
+} // NS OpenEngine
@@ -0,0 +1,281 @@
+// 
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+
+#ifndef _OE_PROPERTY_VALUE_H_
+#define _OE_PROPERTY_VALUE_H_
+
+#include "PropertyTree.h"
+#include <string>
+#include <sstream>
+#include <Math/Vector.h>
+#include <Math/RGBAColor.h>
+
+namespace OpenEngine {
+namespace Utils {
+
+using namespace std;
+    // Typing
+
+    template <class T>
+    PropertyTree::PropertyType WhatType() {
+        return PropertyTree::UNKNOWN;
+    }
+
+    template <> PropertyTree::PropertyType WhatType<Math::Vector<3,float> >();
+    template <> PropertyTree::PropertyType WhatType<Math::RGBAColor >();
+    template <> PropertyTree::PropertyType WhatType<float >();
+    template <> PropertyTree::PropertyType WhatType<double >();
+    template <> PropertyTree::PropertyType WhatType<int >();
+    template <> PropertyTree::PropertyType WhatType<unsigned int >();
+    template <> PropertyTree::PropertyType WhatType<long long >();
+    template <> PropertyTree::PropertyType WhatType<bool >();
+    template <> PropertyTree::PropertyType WhatType<string >();
+
+    // Type names used as YAML tags
+    const char* TypeToName(PropertyTree::PropertyType t);
+    PropertyTree::PropertyType TypeFromName(const string& name);
+
+    // String conversion
+
+    template<class T>
+    string ConvertToString(T val) {
+        ostringstream ostream;
+        ostream << val;
+        return ostream.str();
+    }
+
+    template <> 
+    string ConvertToString<Math::Vector<3,float> >(Math::Vector<3,float>);
+    template <> 
+    string ConvertToString<Math::Vector<4,float> >(Math::Vector<4,float>);
+    template <>
+    string ConvertToString<Math::RGBAColor >(Math::RGBAColor);
+
+    template <class T>
+    T ConvertFromString(string s) {
+        istringstream istream(s);
+        T val;
+        istream >> val;
+        return val;
+    }
+
+    template <> Math::Vector<3,float> ConvertFromString<Math::Vector<3,float> >(string s);
+    template <> Math::Vector<4,float> ConvertFromString<Math::Vector<4,float> >(string s);
+    template <> Math::RGBAColor ConvertFromString<Math::RGBAColor >(string s);
+
+template <class T> struct PropertyValueTraits;
+
+/**
+ * Scalar value of a property tree node.
+ *
+ * Values are kept in their native representation, tagged with the
+ * property type they were stored as. Text loaded from a file is kept
+ * as a STRING until it is read as a native type, at which point it is
+ * parsed once and stored natively. The text it was parsed from is
+ * kept and saved until the value is stored again, so reading a value
+ * does not change the file. Other values are only turned into text
+ * when they are saved or printed.
+ *
+ * Text is held as a counted reference to an atom (see
+ * PropertyAtomTable), the parsed text and the source share it. Text
+ * stored by code is held in an atom of its own.
+ *
+ * @class PropertyValue PropertyValue.h ons/PropertyTree/Utils/PropertyValue.h
+ */
+class PropertyValue {
+private:
+    template <class T> friend struct PropertyValueTraits;
+
+    PropertyTree::PropertyType type;
+    // text a native value was parsed from, NULL once it is stored
+    const PropertyAtom* source;
+    union {
+        int i;
+        unsigned int u;
+        float f;
+        double d;
+        long long l;
+        bool b;
+        const PropertyAtom* text;
+    } data;
+
+    template <class T>
+    bool Parse();
+
+    void ReleaseText() {
+        if (type == PropertyTree::STRING) {
+            PropertyAtom::Release(data.text);
+            type = PropertyTree::UNKNOWN;
+        }
+        if (source)
+            PropertyAtom::Release(source);
+        source = NULL;
+    }
+    void Assign(const PropertyValue& other) {
+        type = other.type;
+        data = other.data;
+        source = other.source ? PropertyAtom::Retain(other.source) : NULL;
+        if (type == PropertyTree::STRING)
+            PropertyAtom::Retain(data.text);
+    }
+    const PropertyAtom* GetText() const {
+        return type == PropertyTree::STRING ? data.text : source;
+    }
+public:
+    PropertyValue() : type(PropertyTree::UNKNOWN), source(NULL) { data.l = 0; }
+    PropertyValue(const PropertyValue& other) { Assign(other); }
+    ~PropertyValue() { ReleaseText(); }
+
+    PropertyValue& operator=(const PropertyValue& other) {
+        if (this != &other) {
+            ReleaseText();
+            Assign(other);
+        }
+        return *this;
+    }
+
+    PropertyTree::PropertyType GetType() const { return type; }
+    bool IsSet() const { return type != PropertyTree::UNKNOWN; }
+
+    void SetText(const string& s) {
+        PropertyAtom* a = new PropertyAtom();
+        a->str = s;
+        SetText(a);
+    }
+    void SetText(const PropertyAtom* a) {
+        PropertyAtom::Retain(a);
+        ReleaseText();
+        type = PropertyTree::STRING;
+        data.text = a;
+    }
+
+    // Move text interned in another table into table
+    void Intern(PropertyAtomTable& table);
+
+    // Parse text into the native representation of t. Returns false
+    // if the text is not a complete value of that type.
+    bool ConvertTo(PropertyTree::PropertyType t);
+
+    template <class T>
+    T As() const;
+
+    template <class T>
+    void Store(T val) {
+        PropertyValueTraits<T>::Store(*this, val);
+    }
+
+    template <class T>
+    void Load(T* val) {
+        if (type == PropertyTree::STRING)
+            ConvertTo(WhatType<T>());
+        PropertyValueTraits<T>::Load(*this, val);
+    }
+
+    string ToString() const;
+
+    // True if both values hold or were parsed from the same text
+    bool SameText(const PropertyValue& other) const {
+        const PropertyAtom* a = GetText();
+        const PropertyAtom* b = other.GetText();
+        return a && b && (a == b || a->str == b->str);
+    }
+
+    bool operator==(const PropertyValue& other) const;
+    bool operator!=(const PropertyValue& other) const {
+        return !(*this == other);
+    }
+};
+
+template <class T>
+T PropertyValue::As() const {
+    switch (type) {
+    case PropertyTree::INT32:  return T(data.i);
+    case PropertyTree::UINT32: return T(data.u);
+    case PropertyTree::FLOAT:  return T(data.f);
+    case PropertyTree::DOUBLE: return T(data.d);
+    case PropertyTree::INT64:  return T(data.l);
+    case PropertyTree::BOOL:   return T(data.b);
+    case PropertyTree::STRING: return ConvertFromString<T>(data.text->str);
+    default: return T();
+    }
+}
+
+template <class T>
+bool PropertyValue::Parse() {
+    istringstream istream(data.text->str);
+    T val;
+    istream >> val;
+    if (istream.fail())
+        return false;
+    istream >> ws;
+    if (!istream.eof())
+        return false;
+    // the text becomes the source, it is not released by Store
+    const PropertyAtom* text = data.text;
+    type = PropertyTree::UNKNOWN;
+    PropertyValueTraits<T>::Store(*this, val);
+    source = text;
+    return true;
+}
+
+// Types without a native representation are kept as text.
+template <class T>
+struct PropertyValueTraits {
+    static void Store(PropertyValue& v, T val) {
+        v.SetText(ConvertToString(val));
+    }
+    static void Load(const PropertyValue& v, T* val) {
+        if (v.IsSet())
+            *val = ConvertFromString<T>(v.ToString());
+    }
+};
+
+template <>
+struct PropertyValueTraits<string> {
+    static void Store(PropertyValue& v, string val) {
+        v.SetText(val);
+    }
+    static void Load(const PropertyValue& v, string* val) {
+        if (v.type == PropertyTree::STRING)
+            *val = v.data.text->str;
+        else if (v.IsSet())
+            *val = v.ToString();
+    }
+};
+
+#define OE_PROPERTY_NATIVE_VALUE(T, TYPE, FIELD)                       \
+template <>                                                            \
+struct PropertyValueTraits<T> {                                        \
+    static void Store(PropertyValue& v, T val) {                       \
+        v.ReleaseText();                                               \
+        v.type = PropertyTree::TYPE;                                   \
+        v.data.FIELD = val;                                            \
+    }                                                                  \
+    static void Load(const PropertyValue& v, T* val) {                 \
+        if (v.type == PropertyTree::TYPE)                              \
+            *val = v.data.FIELD;                                       \
+        else if (v.IsSet())                                            \
+            *val = v.As<T>();                                          \
+    }                                                                  \
+};
+
+OE_PROPERTY_NATIVE_VALUE(int, INT32, i)
+OE_PROPERTY_NATIVE_VALUE(unsigned int, UINT32, u)
+OE_PROPERTY_NATIVE_VALUE(float, FLOAT, f)
+OE_PROPERTY_NATIVE_VALUE(double, DOUBLE, d)
+OE_PROPERTY_NATIVE_VALUE(long long, INT64, l)
+OE_PROPERTY_NATIVE_VALUE(bool, BOOL, b)
+
+#undef OE_PROPERTY_NATIVE_VALUE
+
+} // NS Utils
+} // NS OpenEngine
+
+#endif // _OE_PROPERTY_VALUE_H_